@@ -28,12 +28,36 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
-//static struct thread* awake_thread;					/* wait_list에서 가장 먼저 깨울 스레드를 전역 변수로 관리 */
+/* 8254 input frequency, and input clocks per timer tick (the
+   counter's reload value in periodic mode). */
+#define PIT_HZ 1193180
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* -tickless: stop the periodic tick while the CPU is idle?
+
+   When set, the idle thread reprograms the PIT as a one-shot
+   timer that fires at the tick boundary of the earliest sleeping
+   thread's deadline (at most ~55 ms away, the 16-bit counter's
+   range) instead of taking every tick.  The ticks that passed in
+   the meantime are credited when the CPU wakes up, either by the
+   one-shot itself or by another device's interrupt. */
+bool timer_tickless;
+
+/* Number of whole ticks covered by the armed one-shot, or 0 when
+   the PIT is running in periodic mode. */
+static int64_t oneshot_ticks;
+
+/* Tickless statistics. */
+static int64_t oneshot_cnt;     /* # of one-shots armed. */
+static int64_t skipped_ticks;   /* # of tick interrupts avoided. */
 
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void pit_program (uint8_t mode, uint16_t count);
+static uint16_t pit_read_count (bool *expired);
+static void timer_catch_up (int64_t elapsed);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -42,11 +66,7 @@ void
 timer_init (void) {
 	/* 8254 input frequency divided by TIMER_FREQ, rounded to
 	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
+	pit_program (2, PIT_TICK_COUNT);
 
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -102,16 +122,21 @@ timer_sleep (int64_t ticks) {
 	int64_t start = timer_ticks ();
 
 	ASSERT (intr_get_level () == INTR_ON);
-	int64_t awake_ticks = start + ticks;
+	timer_sleep_until (start + ticks);
+}
 
-	// 현재 스레드의 awake_ticks를 넣어주고, wait_list에 넣어주고, block 처리(스레드 상태 변경)를 해준다.
-	struct thread* curr = thread_current(); // running_thread 랑 고민됨..
-	curr->awake_ticks = awake_ticks;
-	thread_wait();
+/* Suspends execution until the timer reaches DEADLINE ticks since
+   boot.  Returns immediately if DEADLINE has already passed.
+   Periodic tasks should advance an absolute deadline and call
+   this, rather than timer_sleep(), so that the time spent between
+   wake-ups does not accumulate as drift. */
+void
+timer_sleep_until (int64_t deadline) {
+	ASSERT (intr_get_level () == INTR_ON);
 
-	// pooling 방식을 interrupt 방식으로 변경함에 따라 주석 처리
-	// while (timer_elapsed (start) < ticks)
-	// 	thread_yield ();
+	if (deadline <= timer_ticks ())
+		return;
+	thread_sleep (deadline);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -136,16 +161,141 @@ timer_nsleep (int64_t ns) {
 void
 timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+	if (timer_tickless)
+		printf ("Timer: %"PRId64" one-shots, %"PRId64" ticks skipped\n",
+				oneshot_cnt, skipped_ticks);
+}
+
+/* Halts the CPU until the next interrupt.  Called by the idle
+   thread with interrupts off; returns with interrupts on.
+
+   In tickless mode, if no sleeping thread is due on the next tick,
+   first switches the PIT to a one-shot that fires on the tick
+   boundary where the earliest sleeper is due.  The count is
+   measured from the current position within the periodic cycle,
+   so the tick phase is preserved across the idle period. */
+void
+timer_idle (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (timer_tickless && oneshot_ticks == 0) {
+		int64_t delta = thread_next_awake () - ticks;
+		if (delta > 1) {
+			/* Input clocks left until the next periodic tick. */
+			uint16_t remaining = pit_read_count (NULL);
+			int64_t max = 1 + (0xffff - remaining) / PIT_TICK_COUNT;
+
+			if (delta > max)
+				delta = max;
+			pit_program (0, (delta - 1) * PIT_TICK_COUNT + remaining);
+			oneshot_ticks = delta;
+			oneshot_cnt++;
+		}
+	}
+
+	/* The `sti' instruction disables interrupts until the
+	   completion of the next instruction, so these two
+	   instructions are executed atomically.  This atomicity is
+	   important; otherwise, an interrupt could be handled
+	   between re-enabling interrupts and waiting for the next
+	   one to occur, wasting as much as one clock tick worth of
+	   time.
+
+	   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+	   7.11.1 "HLT Instruction". */
+	asm volatile ("sti; hlt" : : : "memory");
+}
+
+/* Called on entry to every external interrupt other than the
+   timer's own.  If the CPU was woken out of a tickless idle
+   period early, credits the whole ticks that have passed and
+   rearms the PIT to fire once more at the next tick boundary,
+   where timer_interrupt() resumes periodic mode.  This must
+   happen before the device's handler runs, since it may wake a
+   thread that reads timer_ticks(). */
+void
+timer_irq_enter (void) {
+	uint16_t remaining;
+	int64_t elapsed, whole;
+	bool expired;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (oneshot_ticks <= 1)
+		return;
+
+	remaining = pit_read_count (&expired);
+	if (expired) {
+		/* The one-shot has fired and its interrupt is pending;
+		   timer_interrupt() will account for the whole period. */
+		return;
+	}
+
+	/* The one-shot fires at the end of tick ticks + oneshot_ticks,
+	   so the count still to go spans that many tick periods. */
+	elapsed = (int64_t) oneshot_ticks * PIT_TICK_COUNT - remaining;
+	whole = elapsed / PIT_TICK_COUNT;
+	if (whole > oneshot_ticks - 1)
+		whole = oneshot_ticks - 1;
+	if (whole > 0)
+		timer_catch_up (whole);
+
+	remaining -= (oneshot_ticks - 1 - whole) * PIT_TICK_COUNT;
+	pit_program (0, remaining > 0 ? remaining : 1);
+	oneshot_ticks = 1;
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
+	if (oneshot_ticks > 0) {
+		/* End of a tickless period: credit all but the current
+		   tick, which is handled below as usual, and go back to
+		   periodic mode. */
+		timer_catch_up (oneshot_ticks - 1);
+		oneshot_ticks = 0;
+		pit_program (2, PIT_TICK_COUNT);
+	}
+
 	ticks++;
 	thread_awake(ticks);
 	thread_tick ();
 }
 
+/* Credits ELAPSED ticks that passed with the periodic tick
+   stopped.  The CPU was idle for all of them. */
+static void
+timer_catch_up (int64_t elapsed) {
+	ticks += elapsed;
+	skipped_ticks += elapsed;
+	thread_tick_idle (elapsed);
+}
+
+/* Programs 8254 counter 0 in MODE (0 = interrupt on terminal
+   count, 2 = rate generator) with initial COUNT. */
+static void
+pit_program (uint8_t mode, uint16_t count) {
+	outb (0x43, 0x30 | (mode << 1));  /* CW: counter 0, LSB then MSB, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Returns counter 0's current count.  If EXPIRED is nonnull,
+   sets *EXPIRED to the state of the counter's output pin, which
+   in one-shot mode goes high once the count has run out. */
+static uint16_t
+pit_read_count (bool *expired) {
+	uint8_t status, lo, hi;
+
+	outb (0x43, 0xc2);    /* Read-back: latch status and count of counter 0. */
+	status = inb (0x40);
+	lo = inb (0x40);
+	hi = inb (0x40);
+	if (expired != NULL)
+		*expired = (status & 0x80) != 0;
+	return lo | (hi << 8);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -0,0 +1,69 @@
+#ifndef __LIB_KERNEL_PQUEUE_H
+#define __LIB_KERNEL_PQUEUE_H
+
+/* Priority queue.
+ *
+ * This is a pairing heap: a tree in which every node is at least
+ * as high as its children, where each node keeps its children in
+ * a linked list.  Pushing is O(1), and popping the highest
+ * element or removing an arbitrary one is O(log n) amortized.
+ *
+ * Like the list and hash table, the queue does not use dynamic
+ * allocation.  Each structure that can potentially be in a
+ * priority queue must embed a struct pq_elem member, and the
+ * pq_entry macro converts from a struct pq_elem back to the
+ * structure that contains it.
+ *
+ * Elements that compare equal come out in the order they were
+ * pushed.  If an element's key changes while it is in a queue,
+ * call pq_update() before the queue is used again. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Priority queue element. */
+struct pq_elem {
+	struct pq_elem *child;      /* Leftmost child. */
+	struct pq_elem *next;       /* Next sibling to the right. */
+	struct pq_elem *prev;       /* Left sibling, or parent if leftmost. */
+	uint64_t seq;               /* Push order, for breaking ties. */
+};
+
+/* Converts pointer to priority queue element PQ_ELEM into a
+ * pointer to the structure that PQ_ELEM is embedded inside.
+ * Supply the name of the outer structure STRUCT and the member
+ * name MEMBER of the element. */
+#define pq_entry(PQ_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(PQ_ELEM)->child     \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two priority queue elements A and B,
+ * given auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B.  The highest element
+ * is at the front of the queue. */
+typedef bool pq_less_func (const struct pq_elem *a,
+		const struct pq_elem *b,
+		void *aux);
+
+/* Priority queue. */
+struct pq {
+	struct pq_elem *root;       /* Highest element, or null. */
+	size_t elem_cnt;            /* Number of elements. */
+	uint64_t next_seq;          /* Sequence number for next push. */
+	pq_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void pq_init (struct pq *, pq_less_func *, void *aux);
+
+void pq_push (struct pq *, struct pq_elem *);
+struct pq_elem *pq_front (struct pq *);
+struct pq_elem *pq_pop (struct pq *);
+void pq_remove (struct pq *, struct pq_elem *);
+void pq_update (struct pq *, struct pq_elem *);
+
+size_t pq_size (struct pq *);
+bool pq_empty (struct pq *);
+
+#endif /* lib/kernel/pqueue.h */
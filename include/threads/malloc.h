@@ -9,5 +9,10 @@ void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_print_stats (void);
+#ifdef MALLOC_DEBUG
+void malloc_print_leaks (void);
+#endif
+void register_alloc_inspect_intr (void);
 
 #endif /* threads/malloc.h */
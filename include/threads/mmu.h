@@ -2,12 +2,37 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Tag TLB entries with process-context identifiers, if the CPU
+   supports them? */
+extern bool mmu_pcid;
+
+void mmu_init (void);
+void mmu_print_stats (void);
+
+/* A batch of TLB invalidations for one page map.  Changing many
+   page table entries through a batch and then flushing it costs
+   one invlpg per changed page, or a single CR3 reload once more
+   than TLB_BATCH_MAX pages have changed, instead of one check of
+   CR3 and one invlpg per call. */
+#define TLB_BATCH_MAX 32
+struct tlb_batch {
+	uint64_t *pml4;                 /* Page map whose entries changed. */
+	size_t cnt;                     /* Number of pages queued. */
+	uint64_t va[TLB_BATCH_MAX];     /* Pages to invalidate. */
+};
+
+void tlb_batch_init (struct tlb_batch *, uint64_t *pml4);
+void tlb_batch_add (struct tlb_batch *, const void *va);
+void tlb_batch_flush (struct tlb_batch *);
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
@@ -15,11 +40,16 @@ void pml4_activate (uint64_t *pml4);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
+void pml4_clear_range (uint64_t *pml4, void *upage, size_t page_cnt,
+		struct tlb_batch *);
+void pml4_protect_range (uint64_t *pml4, void *upage, size_t page_cnt,
+		bool rw, struct tlb_batch *);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+#define is_large_pte(pte) (*(pte) & PTE_PS)
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
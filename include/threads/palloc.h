@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -11,13 +12,59 @@ enum palloc_flags {
 	PAL_USER = 004              /* User page. */
 };
 
+/* Allocation counters, kept for each page pool and for each
+   malloc() size class.  Units are pages or blocks. */
+struct alloc_stats {
+	long long cur;              /* Units currently allocated. */
+	long long peak;             /* Highest value CUR has reached. */
+	long long allocs;           /* Successful allocations. */
+	long long frees;            /* Frees. */
+	long long fails;            /* Failed allocations. */
+};
+
+/* Records an allocation of CNT units in S. */
+static inline void
+alloc_stats_alloc (struct alloc_stats *s, long long cnt) {
+	s->allocs++;
+	s->cur += cnt;
+	if (s->cur > s->peak)
+		s->peak = s->cur;
+}
+
+/* Records that an allocation in S grew by CNT units, or shrank
+   if CNT is negative. */
+static inline void
+alloc_stats_resize (struct alloc_stats *s, long long cnt) {
+	s->cur += cnt;
+	if (s->cur > s->peak)
+		s->peak = s->cur;
+}
+
+/* Records a free of CNT units in S. */
+static inline void
+alloc_stats_free (struct alloc_stats *s, long long cnt) {
+	s->frees++;
+	s->cur -= cnt;
+}
+
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Zero free pages in the background for PAL_ZERO requests? */
+extern bool palloc_prezero;
+
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_page_cnt);
+void palloc_shrink (void *, size_t page_cnt, size_t new_page_cnt);
+void palloc_start_prezero (void);
+void palloc_print_stats (void);
+const struct alloc_stats *palloc_stats (enum palloc_flags);
+#ifdef MALLOC_DEBUG
+void palloc_for_each_owner (void (*) (void *caller, size_t page_cnt));
+#endif
 
 #endif /* threads/palloc.h */
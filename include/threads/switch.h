@@ -0,0 +1,18 @@
+#ifndef THREADS_SWITCH_H
+#define THREADS_SWITCH_H
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+struct intr_frame;
+
+/* Switches from the running thread to the next one.  Saves the
+   running thread's callee-saved registers on its stack and its
+   stack pointer in *CUR_RSP, then resumes the next thread from
+   NEXT_RSP, or launches it from NEXT_TF if NEXT_RSP is 0.
+   Returns when the running thread is switched back to. */
+void switch_threads (uint64_t *cur_rsp, uint64_t next_rsp,
+		struct intr_frame *next_tf);
+#endif
+
+#endif /* threads/switch.h */
@@ -2,18 +2,22 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <pqueue.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct pq waiters;          /* Waiting threads, highest priority first. */
 };
 
-/* One semaphore in a list. */
+/* One semaphore in a condition variable's waiters. */
 struct semaphore_elem {
-    struct list_elem elem;              /* List element. */
+    struct pq_elem elem;                /* Priority queue element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
+    struct condition *cond;             /* Condition waited for. */
 };
 
 void sema_init(struct semaphore *, unsigned value);
@@ -21,12 +25,22 @@ void sema_down(struct semaphore *);
 bool sema_try_down(struct semaphore *);
 void sema_up(struct semaphore *);
 void sema_self_test(void);
-bool cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux);
+void synch_priority_changed(struct thread *);
+void synch_thread_init(struct thread *);
+
+/* Lock states.  A held lock's state is the address of its holder,
+   which is page-aligned, with LOCK_CONTENDED set if other threads
+   may be waiting for it. */
+#define LOCK_FREE 0             /* Not held. */
+#define LOCK_CONTENDED 1        /* Held, and may have waiters. */
 
 /* Lock. */
 struct lock {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
-    struct semaphore semaphore; /* Binary semaphore controlling access. */
+    uintptr_t state;            /* LOCK_FREE, or holder | LOCK_CONTENDED. */
+    struct semaphore semaphore; /* Waiters; its value is unused. */
+    int max_priority;           /* Highest waiter priority, or -1. */
+    struct pq_elem held_elem;   /* Element in holder's held_locks. */
+    bool donating;              /* In holder's held_locks? */
 };
 
 void lock_init(struct lock *);
@@ -34,16 +48,28 @@ void lock_acquire(struct lock *);
 bool lock_try_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_held_by_current_thread(const struct lock *);
+struct thread *lock_holder(const struct lock *);
 
-bool thread_compare_donate_priority(const struct list_elem *l, const struct list_elem *s, void *aux);
+/* Readers-writer lock.  Writers are preferred: once a writer is
+   waiting, new readers wait behind it.  Threads waiting to read
+   or write donate their priority to the writer. */
+struct rwlock {
+    struct lock lock;           /* Held by the writer, briefly by readers. */
+    struct semaphore drained;   /* Writer waits here for readers to leave. */
+    unsigned readers;           /* Number of readers holding the lock. */
+};
 
-// 필요한 함수 선언들
-void remove_with_lock(struct lock *lock);
-void refresh_priority(void);
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_held_for_write(const struct rwlock *);
 
 /* Condition variable. */
 struct condition {
-    struct list waiters;        /* List of waiting threads. */
+    struct pq waiters;          /* Waiting semaphore_elems, highest
+                                   priority thread first. */
 };
 
 void cond_init(struct condition *);
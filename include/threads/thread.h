@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #ifdef VM
@@ -28,6 +29,14 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Number of buckets in ready-queue latency histograms. */
+#define READY_HIST_BUCKETS 8
+
 #define FDT_PAGES 3
 #define FDT_COUNT_LIMIT 128
 #define MAX_FD (1 << 9)
@@ -82,12 +91,10 @@ typedef int tid_t;
  * the `magic' member of the running thread's `struct thread' is
  * set to THREAD_MAGIC.  Stack overflow will normally change this
  * value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
- * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
- * only because they are mutually exclusive: only a thread in the
- * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c).
+ * A thread waiting on a semaphore is instead in the semaphore's
+ * priority queue through `wait_elem' (synch.c), which stays
+ * ordered as donation changes the waiter's priority. */
 
 
 
@@ -99,13 +106,31 @@ struct thread {
 	int priority;                       /* Priority. */
 	int64_t awake_ticks;				/* awake ticks */
                                                                                                                                                                                                                                                                                                                                                                                                     
-	/* Shared between thread.c and synch.c(semaphore->waiters). */
+	/* Owned by thread.c. */
 	struct list_elem elem;              /* List element. */
 
-	int init_priority;
-	struct lock *wait_on_lock;
-	struct list donations;				
-	struct list_elem donation_elem;
+	/* Waiting on synchronization primitives (synch.c). */
+	struct pq_elem wait_elem;           /* Semaphore waiters element. */
+	struct semaphore *waiting_on;       /* Semaphore waited on. */
+	struct semaphore_elem *cond_waiter; /* Condition variable waiter. */
+
+	/* Priority donation (synch.c). */
+	int init_priority;                  /* Priority before donation. */
+	struct lock *wait_on_lock;          /* Lock being waited for. */
+	struct pq held_locks;               /* Contended locks held, highest
+	                                       max_priority first. */
+
+	/* MLFQS scheduler state (thread.c). */
+	int nice;                           /* Niceness. */
+	fixed_t recent_cpu;                 /* Recent CPU usage. */
+	struct list_elem allelem;           /* List element for all_list. */
+
+	/* CPU accounting (thread.c). */
+	int64_t run_ticks;                  /* Timer ticks spent running. */
+	unsigned nvcsw;                     /* Voluntary context switches. */
+	unsigned nivcsw;                    /* Involuntary context switches. */
+	uint64_t ready_since;               /* TSC when last made ready. */
+	unsigned ready_hist[READY_HIST_BUCKETS]; /* Ready-queue latency. */
 
 
 #ifdef USERPROG
@@ -119,6 +144,7 @@ struct thread {
 
 	/* Owned by thread.c. */
 	struct intr_frame tf;               /* Information for switching */
+	uint64_t switch_rsp;                /* Saved rsp, see switch.S. */
 	// 자식 프로세스 생성시 지금은 fork를 수행하면서 context switch가 일어난 상태로
 	// 현재 부모에는 커널이 작업하던 정보가 저장되어 있음
 	// 따라서 syscall에서 f를 fork 함수에 전달해서 활용해야 한다.
@@ -126,6 +152,7 @@ struct thread {
 	// 자식 지정 리스트를 설정하기 위한 필드 child_list, child_elem을 추가한다
 	struct list child_list;
 	struct list_elem child_elem;
+	struct thread *parent;              /* Null once unlinked from parent. */
 	// 부모는 이 load가 완료될 때까지 대기해야함
 	// semaphore를 활용해 Load가 완료될 때까지 부모를 재우자
 	struct semaphore load_sema;
@@ -149,21 +176,26 @@ struct thread *get_child_process(int pid);
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true (default), kernel-to-kernel switches save only the
+   callee-saved registers.  Cleared by "-o no-fast-switch". */
+extern bool thread_fast_switch;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (int64_t n);
 void thread_print_stats (void);
+void thread_print_trace (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 
 void test_max_priority (void);
-bool cmp_priority_wait(const struct list_elem* A, const struct list_elem *B, void *aux);
-bool cmp_priority_ready(const struct list_elem* A, const struct list_elem *B, void *aux);
-void thread_awake(int64_t ticks);
-void thread_wait();
+void thread_awake (int64_t ticks);
+void thread_sleep (int64_t awake_ticks);
+int64_t thread_next_awake (void);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
@@ -174,28 +206,18 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
-
-struct list* thread_get_wait_list(void);			/* wait list의 주소 반환 */
+void thread_preempt (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
-bool
-thread_compare_donate_priority (const struct list_elem *l, 
-				const struct list_elem *s, void *aux UNUSED);
-
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
 void do_iret (struct intr_frame *tf);
-void donate_priority();
-
-void remove_with_lock(struct lock *lock);
 void refresh_priority (void);
 bool check_priority_threads();
-bool
-thread_compare_donate_priority (const struct list_elem *l, 
-				const struct list_elem *s, void *aux UNUSED);
+void thread_change_priority (struct thread *, int priority);
 
 #endif /* threads/thread.h */
@@ -10,6 +10,7 @@ int process_exec (void *f_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (struct thread *next);
+void process_print_stats (void);
 void argument_stack(char **parse, int count, void **rsp);
 int process_add_file(struct file *f);
 struct file *process_get_file(int fd);
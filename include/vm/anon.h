@@ -1,13 +1,24 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <stddef.h>
 #include "vm/vm.h"
 struct page;
+struct frame;
 enum vm_type;
 
+/* Most pages anon_swap_out_batch() writes out at once. */
+#define SWAP_BATCH_MAX 8
+
 struct anon_page {
+	size_t slot;            /* Swap slot holding a copy, or SIZE_MAX. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_swap_out_batch (struct frame **frames, size_t cnt, bool *success);
+size_t anon_swap_neighbours (struct page *page, struct page **pages,
+		size_t max);
+void anon_fork (struct page *parent, struct page *child);
+void anon_print_stats (void);
 
 #endif
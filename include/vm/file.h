@@ -9,6 +9,16 @@ enum vm_type;
 struct file_page {
 };
 
+/* Contents of a page that is loaded from a file on first touch:
+ * READ_BYTES bytes of FILE starting at offset OFS, followed by
+ * zeros to the end of the page.  Used as the AUX of such a page's
+ * initializer, so it must come from malloc(). */
+struct file_load_aux {
+	struct file *file;
+	off_t ofs;
+	size_t read_bytes;
+};
+
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
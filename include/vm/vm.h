@@ -1,6 +1,7 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -46,6 +47,10 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;  /* Element in supplemental_page_table. */
+	struct list_elem frame_elem; /* Element in struct frame's pages. */
+	uint64_t *pml4;             /* Page map that maps VA. */
+	bool writable;              /* May the process write to it? */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +64,18 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".  After fork, the parent's and
+ * the child's copies of a page share its frame, mapped read-only,
+ * until one of them writes to it.  PAGES lists every page that
+ * the frame backs; PAGE is the first of them. */
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list pages;          /* Pages backed by this frame. */
+	int page_cnt;               /* Number of pages in PAGES. */
+	struct list_elem elem;      /* Element in the frame table. */
+	bool tracked;               /* In the frame table? */
+	bool pinned;                /* Keep the clock away? */
 };
 
 /* The function table for page operations.
@@ -81,10 +94,38 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* Kinds of regions of a process's address space. */
+enum vm_region_kind {
+	VM_REGION_CODE,             /* Read-only ELF segment. */
+	VM_REGION_DATA,             /* Writable ELF segment. */
+	VM_REGION_STACK,            /* User stack. */
+	VM_REGION_MMAP,             /* Memory-mapped file. */
+};
+
+/* A page-aligned range of user virtual addresses, [START, END). */
+struct vm_region {
+	void *start;
+	void *end;
+	enum vm_region_kind kind;
+};
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ *
+ * PAGES holds a struct page for every user page the process may
+ * touch, keyed by its page-aligned virtual address, so that a
+ * page fault finds its page in expected constant time.
+ *
+ * REGIONS holds the process's regions in an array sorted by
+ * start address.  Regions never overlap, so binary search finds
+ * the region containing an address, or any region overlapping a
+ * range, in O(log n) time without visiting the range's pages.
+ * Processes have few regions, so keeping the array sorted on
+ * insertion is cheap. */
 struct supplemental_page_table {
+	struct hash pages;          /* struct page's, by va. */
+	struct vm_region *regions;  /* Regions, sorted by start. */
+	size_t region_cnt;          /* Number of regions. */
+	size_t region_cap;          /* Number of elements allocated. */
 };
 
 #include "threads/thread.h"
@@ -96,8 +137,17 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_add_region (struct supplemental_page_table *spt, void *start,
+		void *end, enum vm_region_kind kind);
+struct vm_region *spt_find_region (struct supplemental_page_table *spt,
+		const void *va);
+bool spt_range_is_free (struct supplemental_page_table *spt,
+		const void *start, const void *end);
+void spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region);
 
 void vm_init (void);
+void vm_print_stats (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -107,6 +157,7 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+void vm_free_frame (struct page *page);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
@@ -62,6 +62,57 @@ last_mask (const struct bitmap *b) {
 	int last_bits = b->bit_cnt % ELEM_BITS;
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Works a whole
+   element at a time: bits that do not match VALUE are skipped 64
+   at a time and the first match in an element is found by
+   counting trailing zeros. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, bool value) {
+	size_t idx = elem_idx (start);
+	size_t last = elem_cnt (b->bit_cnt);
+	elem_type flip = value ? 0 : (elem_type) -1;
+	elem_type e;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	/* Ignore the bits below START in its element. */
+	e = (b->bits[idx] ^ flip) & ((elem_type) -1 << (start % ELEM_BITS));
+	while (e == 0) {
+		if (++idx >= last)
+			return b->bit_cnt;
+		e = b->bits[idx] ^ flip;
+	}
+
+	start = idx * ELEM_BITS + __builtin_ctzl (e);
+	return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
+/* Returns the number of 1-bits in E.  (The kernel is not linked
+   against libgcc, so __builtin_popcountl() is not available.) */
+static inline size_t
+popcount (elem_type e) {
+	e = e - ((e >> 1) & 0x5555555555555555UL);
+	e = (e & 0x3333333333333333UL) + ((e >> 2) & 0x3333333333333333UL);
+	e = (e + (e >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (e * 0x0101010101010101UL) >> 56;
+}
+
+/* Returns a mask of the bits of element number IDX that fall in
+   bits START through END, exclusive, of a bitmap. */
+static inline elem_type
+range_mask (size_t idx, size_t start, size_t end) {
+	size_t lo = idx * ELEM_BITS, hi = lo + ELEM_BITS;
+	elem_type mask = (elem_type) -1;
+
+	if (start > lo)
+		mask &= (elem_type) -1 << (start - lo);
+	if (end < hi)
+		mask &= ((elem_type) 1 << (end - lo)) - 1;
+	return mask;
+}
 
 /* Creation and destruction. */
 
@@ -194,50 +245,59 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.  Each
+   element is updated with a single store, which is atomic on a
+   uniprocessor machine, but the elements are not updated
+   atomically together. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
+	size_t idx;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	if (cnt == 0)
+		return;
+	for (idx = elem_idx (start); idx <= elem_idx (end - 1); idx++) {
+		elem_type mask = range_mask (idx, start, end);
+		if (value)
+			b->bits[idx] |= mask;
+		else
+			b->bits[idx] &= ~mask;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t idx, true_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	if (cnt == 0)
+		return 0;
+	true_cnt = 0;
+	for (idx = elem_idx (start); idx <= elem_idx (end - 1); idx++)
+		true_cnt += popcount (b->bits[idx]
+				& range_mask (idx, start, end));
+	return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return cnt > 0 && find_bit (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -266,22 +326,55 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Jumps from the start of each run of VALUE bits to its end and
+   then to the start of the next run, so the cost is linear in
+   the number of elements scanned, whatever CNT is. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt == 0)
+		return start;
+	while (cnt <= b->bit_cnt - start) {
+		size_t run_end;
+
+		start = find_bit (b, start, value);
+		if (cnt > b->bit_cnt - start)
+			break;
+		run_end = find_bit (b, start, !value);
+		if (run_end - start >= cnt)
+			return start;
+		start = run_end;
 	}
 	return BITMAP_ERROR;
 }
 
+/* Like bitmap_scan(), but starts at *CURSOR and, if there is no
+   such group after it, wraps around to the start of B.  On
+   success, advances *CURSOR past the group found, so that
+   repeated calls hand out groups in address order instead of
+   searching the same full region over and over. */
+size_t
+bitmap_scan_next_fit (const struct bitmap *b, size_t *cursor, size_t cnt,
+		bool value) {
+	size_t idx;
+
+	ASSERT (b != NULL);
+	ASSERT (cursor != NULL);
+
+	if (*cursor > b->bit_cnt)
+		*cursor = 0;
+	idx = bitmap_scan (b, *cursor, cnt, value);
+	if (idx == BITMAP_ERROR && *cursor > 0)
+		idx = bitmap_scan (b, 0, cnt, value);
+	if (idx != BITMAP_ERROR)
+		*cursor = idx + cnt;
+	return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
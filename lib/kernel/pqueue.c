@@ -0,0 +1,199 @@
+/* Priority queue.
+
+   See pqueue.h for basic information.  The pairing heap is
+   described in Fredman, Sedgewick, Sleator and Tarjan, "The
+   pairing heap: a new form of self-adjusting heap", Algorithmica
+   1(1), 1986.  Pairing is done in two passes without recursion,
+   since kernel stacks are small and a queue may be long. */
+
+#include "pqueue.h"
+#include "../debug.h"
+
+/* Returns true if A belongs in front of B in PQ. */
+static inline bool
+pq_before (struct pq *pq, struct pq_elem *a, struct pq_elem *b) {
+	if (pq->less (b, a, pq->aux))
+		return true;
+	if (pq->less (a, b, pq->aux))
+		return false;
+	return a->seq < b->seq;
+}
+
+/* Melds the trees rooted at A and B, neither of which may have a
+   parent or siblings, and returns the root of the result. */
+static struct pq_elem *
+meld (struct pq *pq, struct pq_elem *a, struct pq_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (pq_before (pq, b, a)) {
+		struct pq_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	/* Make B the leftmost child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Combines the list of sibling trees starting at FIRST into one
+   tree and returns its root, or a null pointer if FIRST is null.
+   The first pass melds trees in pairs from left to right, the
+   second melds the pairs together from right to left. */
+static struct pq_elem *
+merge_pairs (struct pq *pq, struct pq_elem *first) {
+	struct pq_elem *pairs = NULL;
+	struct pq_elem *root = NULL;
+
+	while (first != NULL) {
+		struct pq_elem *a = first;
+		struct pq_elem *b = a->next;
+
+		first = b != NULL ? b->next : NULL;
+		a->prev = a->next = NULL;
+		if (b != NULL) {
+			b->prev = b->next = NULL;
+			a = meld (pq, a, b);
+		}
+
+		/* Stack the pair, so the second pass sees the pairs
+		   from right to left. */
+		a->next = pairs;
+		pairs = a;
+	}
+
+	while (pairs != NULL) {
+		struct pq_elem *a = pairs;
+
+		pairs = a->next;
+		a->next = NULL;
+		root = meld (pq, root, a);
+	}
+	return root;
+}
+
+/* Detaches non-root element E, along with its children, from its
+   parent and siblings. */
+static void
+cut (struct pq_elem *e) {
+	ASSERT (e->prev != NULL);
+
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->prev = e->next = NULL;
+}
+
+/* Links detached element E into PQ, keeping its sequence
+   number. */
+static void
+pq_link (struct pq *pq, struct pq_elem *e) {
+	pq->root = meld (pq, pq->root, e);
+	pq->root->prev = NULL;
+}
+
+/* Removes element E from PQ's tree, leaving E detached with no
+   children.  Does not change the element count. */
+static void
+pq_unlink (struct pq *pq, struct pq_elem *e) {
+	struct pq_elem *children = e->child;
+
+	e->child = NULL;
+	if (e == pq->root)
+		pq->root = merge_pairs (pq, children);
+	else {
+		cut (e);
+		pq->root = meld (pq, pq->root, merge_pairs (pq, children));
+	}
+	if (pq->root != NULL)
+		pq->root->prev = NULL;
+}
+
+/* Initializes PQ as an empty priority queue that compares
+   elements using LESS, given auxiliary data AUX. */
+void
+pq_init (struct pq *pq, pq_less_func *less, void *aux) {
+	ASSERT (pq != NULL);
+	ASSERT (less != NULL);
+
+	pq->root = NULL;
+	pq->elem_cnt = 0;
+	pq->next_seq = 0;
+	pq->less = less;
+	pq->aux = aux;
+}
+
+/* Inserts E into PQ.  E comes out after any element already in
+   PQ that compares equal to it. */
+void
+pq_push (struct pq *pq, struct pq_elem *e) {
+	ASSERT (pq != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	e->seq = pq->next_seq++;
+	pq_link (pq, e);
+	pq->elem_cnt++;
+}
+
+/* Returns the highest element in PQ.  Undefined behavior if PQ is
+   empty. */
+struct pq_elem *
+pq_front (struct pq *pq) {
+	ASSERT (!pq_empty (pq));
+	return pq->root;
+}
+
+/* Removes and returns the highest element in PQ.  Undefined
+   behavior if PQ is empty. */
+struct pq_elem *
+pq_pop (struct pq *pq) {
+	struct pq_elem *e = pq_front (pq);
+
+	pq_remove (pq, e);
+	return e;
+}
+
+/* Removes E, which must be in PQ, from PQ. */
+void
+pq_remove (struct pq *pq, struct pq_elem *e) {
+	ASSERT (pq != NULL);
+	ASSERT (e != NULL);
+	ASSERT (pq->elem_cnt > 0);
+
+	pq_unlink (pq, e);
+	pq->elem_cnt--;
+}
+
+/* Restores PQ's ordering after the key of E, which must be in PQ,
+   has changed in either direction.  E keeps its place among
+   elements that compare equal to it. */
+void
+pq_update (struct pq *pq, struct pq_elem *e) {
+	ASSERT (pq != NULL);
+	ASSERT (e != NULL);
+
+	pq_unlink (pq, e);
+	pq_link (pq, e);
+}
+
+/* Returns the number of elements in PQ. */
+size_t
+pq_size (struct pq *pq) {
+	return pq->elem_cnt;
+}
+
+/* Returns true if PQ is empty, false otherwise. */
+bool
+pq_empty (struct pq *pq) {
+	return pq->elem_cnt == 0;
+}
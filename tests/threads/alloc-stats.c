@@ -0,0 +1,113 @@
+/* Checks the allocator counters that int 0x45 and int 0x46
+   report.
+
+   Allocates and frees a batch of malloc() blocks and of pages
+   from each pool, and verifies that the "current", "peak",
+   "allocs", and "frees" counters move by exactly the amounts
+   expected. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+#define BLOCK_CNT 50            /* malloc() blocks to allocate. */
+#define BLOCK_SIZE 100          /* Size of each block. */
+#define PAGE_CNT 3              /* Pages to allocate from each pool. */
+#define CLASS_MAX 16            /* Most size classes we look at. */
+
+/* Counter numbers, as the inspect interrupts take them. */
+enum { CUR, PEAK, ALLOCS, FREES };
+
+/* Returns counter COUNTER of pool POOL (0 kernel, 1 user). */
+static long long
+inspect_palloc (int pool, int counter) 
+{
+  long long value;
+  asm volatile ("int $0x45"
+                : "=a" (value) : "d" ((uint64_t) pool),
+                  "c" ((uint64_t) counter) : "memory");
+  return value;
+}
+
+/* Returns counter COUNTER of malloc() size class CLASS. */
+static long long
+inspect_malloc (int class, int counter) 
+{
+  long long value;
+  asm volatile ("int $0x46"
+                : "=a" (value) : "d" ((uint64_t) class),
+                  "c" ((uint64_t) counter) : "memory");
+  return value;
+}
+
+static void *blocks[BLOCK_CNT];
+
+void
+test_alloc_stats (void) 
+{
+  long long cur[CLASS_MAX], allocs[CLASS_MAX];
+  int class, class_cnt, grown, pool;
+  int i;
+
+  /* Snapshot every size class. */
+  for (class_cnt = 0; class_cnt < CLASS_MAX; class_cnt++) 
+    {
+      cur[class_cnt] = inspect_malloc (class_cnt, CUR);
+      if (cur[class_cnt] < 0)
+        break;
+      allocs[class_cnt] = inspect_malloc (class_cnt, ALLOCS);
+    }
+  if (class_cnt < 2)
+    fail ("found only %d size classes", class_cnt);
+
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      blocks[i] = malloc (BLOCK_SIZE);
+      if (blocks[i] == NULL)
+        fail ("malloc() failed");
+    }
+
+  /* Exactly one class should hold all of the new blocks. */
+  grown = -1;
+  for (class = 0; class < class_cnt; class++)
+    if (inspect_malloc (class, CUR) != cur[class]) 
+      {
+        if (grown >= 0)
+          fail ("size classes %d and %d both changed", grown, class);
+        grown = class;
+      }
+  if (grown < 0)
+    fail ("no size class changed");
+  if (inspect_malloc (grown, CUR) != cur[grown] + BLOCK_CNT
+      || inspect_malloc (grown, ALLOCS) != allocs[grown] + BLOCK_CNT)
+    fail ("size class %d did not count %d allocations", grown, BLOCK_CNT);
+  if (inspect_malloc (grown, PEAK) < cur[grown] + BLOCK_CNT)
+    fail ("size class %d peak is below its current count", grown);
+  msg ("malloc: one size class counted %d blocks.", BLOCK_CNT);
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+  if (inspect_malloc (grown, CUR) != cur[grown])
+    fail ("size class %d did not count %d frees", grown, BLOCK_CNT);
+  msg ("malloc: freed blocks were counted.");
+
+  for (pool = 0; pool < 2; pool++) 
+    {
+      enum palloc_flags flags = pool ? PAL_USER : 0;
+      long long pool_cur = inspect_palloc (pool, CUR);
+      long long pool_frees = inspect_palloc (pool, FREES);
+      void *pages = palloc_get_multiple (flags, PAGE_CNT);
+
+      if (pages == NULL)
+        fail ("palloc_get_multiple() failed");
+      if (inspect_palloc (pool, CUR) != pool_cur + PAGE_CNT)
+        fail ("pool %d did not count %d pages", pool, PAGE_CNT);
+      palloc_free_multiple (pages, PAGE_CNT);
+      if (inspect_palloc (pool, CUR) != pool_cur
+          || inspect_palloc (pool, FREES) != pool_frees + 1)
+        fail ("pool %d did not count the free", pool);
+      msg ("palloc: %s pool counted %d pages.",
+           pool ? "user" : "kernel", PAGE_CNT);
+    }
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alloc-stats) begin
+(alloc-stats) malloc: one size class counted 50 blocks.
+(alloc-stats) malloc: freed blocks were counted.
+(alloc-stats) palloc: kernel pool counted 3 pages.
+(alloc-stats) palloc: user pool counted 3 pages.
+(alloc-stats) end
+EOF
+pass;
@@ -0,0 +1,81 @@
+/* Measures bitmap_scan() over a 1M-bit map at several fill
+   ratios.
+
+   For each ratio, sets that percentage of the bits at random and
+   then looks for runs of 1, 8, and 64 clear bits, starting from
+   evenly spaced points across the map.  Each scan is checked
+   against a bit-by-bit reference search, and the average number
+   of cycles taken by both is reported. */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "intrinsic.h"
+
+#define BIT_CNT (1024 * 1024)   /* Bits in the map. */
+#define ROUNDS 16               /* Scans timed per run length. */
+
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt)
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j))
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+void
+test_bitmap_scan (void) 
+{
+  static const int fills[] = {0, 50, 90, 99};
+  struct bitmap *b;
+  size_t f, cnt, i;
+
+  b = bitmap_create (BIT_CNT);
+  if (b == NULL)
+    fail ("could not create %d-bit map", BIT_CNT);
+
+  for (f = 0; f < sizeof fills / sizeof *fills; f++) 
+    {
+      for (i = 0; i < BIT_CNT; i++)
+        bitmap_set (b, i, random_ulong () % 100 < (unsigned) fills[f]);
+
+      for (cnt = 1; cnt <= 64; cnt *= 8) 
+        {
+          uint64_t fast = 0, slow = 0;
+          int r;
+
+          for (r = 0; r < ROUNDS; r++) 
+            {
+              size_t start = (size_t) r * (BIT_CNT / ROUNDS);
+              size_t expected, actual;
+              uint64_t t0, t1, t2;
+
+              t0 = rdtsc ();
+              actual = bitmap_scan (b, start, cnt, false);
+              t1 = rdtsc ();
+              expected = reference_scan (b, start, cnt);
+              t2 = rdtsc ();
+              if (actual != expected)
+                fail ("%d%% full, run of %zu from %zu: found %zu, "
+                      "expected %zu", fills[f], cnt, start, actual, expected);
+              fast += t1 - t0;
+              slow += t2 - t1;
+            }
+          msg ("%d%% full, run of %zu: %llu cycles (bit-by-bit %llu)",
+               fills[f], cnt, (unsigned long long) (fast / ROUNDS),
+               (unsigned long long) (slow / ROUNDS));
+        }
+    }
+
+  bitmap_destroy (b);
+  pass ();
+}
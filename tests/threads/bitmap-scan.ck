@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $fill (0, 50, 90, 99) {
+    foreach my $cnt (1, 8, 64) {
+	fail "missing $fill% full, run of $cnt in output"
+	  unless grep (/^\(bitmap-scan\) $fill% full, run of $cnt: \d+ cycles \(bit-by-bit \d+\)$/,
+		       @output);
+    }
+}
+fail "missing PASS in output"
+  unless grep ($_ eq '(bitmap-scan) PASS', @output);
+
+pass;
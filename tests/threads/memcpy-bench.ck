@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing sequential copy time in output"
+  unless grep (/^\(memcpy-bench\) sequential copy of 2048 kB: \d+ cycles$/,
+	       @output);
+fail "missing strided copy time in output"
+  unless grep (/^\(memcpy-bench\) strided copy over 1024 pages: \d+ cycles$/,
+	       @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(memcpy-bench) PASS', @output);
+
+pass;
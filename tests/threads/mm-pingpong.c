@@ -0,0 +1,144 @@
+/* Measures switches between two address spaces.
+
+   Gives a pair of threads a page map each, with the same user
+   pages mapped to different frames, and makes control
+   "ping-pong" between them through two semaphores the way
+   switch-pingpong does.  On each turn a thread activates its
+   own page map, as process_activate() would, and touches every
+   one of its pages, so the round trip pays for reloading CR3
+   and for refilling whatever TLB entries the reload threw
+   away.  Kernel mappings are global and survive the reload;
+   boot with "-pcid" to keep the user mappings as well. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+#define PAGE_CNT 32             /* User pages per address space. */
+#define TRIPS 10000             /* Round trips timed. */
+#define USER_BASE ((uint8_t *) 0x10000000)
+
+struct mm_pingpong 
+  {
+    struct semaphore ping;      /* Upped by main thread. */
+    struct semaphore pong;      /* Upped by helper thread. */
+    struct semaphore done;      /* Upped when helper exits. */
+    bool stop;                  /* Set to make the helper exit. */
+  };
+
+static thread_func pingpong_thread;
+static uint64_t *make_space (void);
+static void touch_space (uint64_t *);
+static void drop_space (uint64_t *);
+
+void
+test_mm_pingpong (void) 
+{
+  struct mm_pingpong pp;
+  uint64_t *pml4;
+  uint64_t start, cycles;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  sema_init (&pp.done, 0);
+  pp.stop = false;
+  pml4 = make_space ();
+  thread_create ("mm-pingpong", PRI_DEFAULT, pingpong_thread, &pp);
+
+  /* Warm up, then time. */
+  sema_up (&pp.ping);
+  sema_down (&pp.pong);
+  start = rdtsc ();
+  for (i = 0; i < TRIPS; i++) 
+    {
+      touch_space (pml4);
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  cycles = rdtsc () - start;
+
+  pp.stop = true;
+  sema_up (&pp.ping);
+  sema_down (&pp.done);
+  drop_space (pml4);
+
+  msg ("%d pages per address space: %llu cycles per round trip",
+       PAGE_CNT, (unsigned long long) (cycles / TRIPS));
+  pass ();
+}
+
+static void
+pingpong_thread (void *pp_) 
+{
+  struct mm_pingpong *pp = pp_;
+  uint64_t *pml4 = make_space ();
+
+  for (;;) 
+    {
+      sema_down (&pp->ping);
+      if (pp->stop)
+        break;
+      touch_space (pml4);
+      sema_up (&pp->pong);
+    }
+  drop_space (pml4);
+  sema_up (&pp->done);
+}
+
+/* Creates a page map with PAGE_CNT zeroed user pages mapped at
+   USER_BASE and, in kernels with user programs, makes it the
+   running thread's so that the scheduler activates it too. */
+static uint64_t *
+make_space (void) 
+{
+  uint64_t *pml4 = pml4_create ();
+  int i;
+
+  if (pml4 == NULL)
+    fail ("pml4_create failed");
+  for (i = 0; i < PAGE_CNT; i++) 
+    {
+      void *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (kpage == NULL
+          || !pml4_set_page (pml4, USER_BASE + i * PGSIZE, kpage, true))
+        fail ("could not map user page %d", i);
+    }
+#ifdef USERPROG
+  thread_current ()->pml4 = pml4;
+#endif
+  return pml4;
+}
+
+/* Activates PML4 and writes to each of its user pages. */
+static void
+touch_space (uint64_t *pml4) 
+{
+  volatile uint8_t *p;
+  int i;
+
+  pml4_activate (pml4);
+  for (i = 0; i < PAGE_CNT; i++) 
+    {
+      p = USER_BASE + i * PGSIZE;
+      *p += 1;
+    }
+}
+
+/* Switches back to the kernel-only page map and destroys PML4,
+   freeing its user pages. */
+static void
+drop_space (uint64_t *pml4) 
+{
+#ifdef USERPROG
+  thread_current ()->pml4 = NULL;
+#endif
+  pml4_activate (NULL);
+  pml4_destroy (pml4);
+}
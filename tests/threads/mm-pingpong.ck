@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing round-trip time in output"
+  unless grep (/^\(mm-pingpong\) \d+ pages per address space: \d+ cycles per round trip$/,
+	       @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(mm-pingpong) PASS', @output);
+
+pass;
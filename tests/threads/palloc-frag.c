@@ -0,0 +1,59 @@
+/* Measures multi-page allocation latency in a fragmented pool.
+
+   Fills part of the user pool with single pages and frees every
+   other one, so that the low end of the pool is a checkerboard
+   of one-page holes.  Then times allocations of 1 to 32 pages,
+   which have to be satisfied from beyond the checkerboard, and
+   reports the average number of cycles each took. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "intrinsic.h"
+
+#define FRAG_PAGES 8192         /* Single pages to fragment with. */
+#define ROUNDS 64               /* Allocations timed per size. */
+
+static void *pages[FRAG_PAGES];
+static void *blocks[ROUNDS];
+
+void
+test_palloc_frag (void) 
+{
+  size_t page_cnt;
+  int i;
+
+  for (i = 0; i < FRAG_PAGES; i++) 
+    {
+      pages[i] = palloc_get_page (PAL_USER);
+      if (pages[i] == NULL)
+        fail ("user pool exhausted after %d pages", i);
+    }
+  for (i = 0; i < FRAG_PAGES; i += 2) 
+    {
+      palloc_free_page (pages[i]);
+      pages[i] = NULL;
+    }
+
+  for (page_cnt = 1; page_cnt <= 32; page_cnt *= 2) 
+    {
+      uint64_t cycles = 0;
+
+      for (i = 0; i < ROUNDS; i++) 
+        {
+          uint64_t start = rdtsc ();
+          blocks[i] = palloc_get_multiple (PAL_USER, page_cnt);
+          cycles += rdtsc () - start;
+          if (blocks[i] == NULL)
+            fail ("%zu-page allocation %d failed", page_cnt, i);
+        }
+      for (i = 0; i < ROUNDS; i++)
+        palloc_free_multiple (blocks[i], page_cnt);
+      msg ("%zu-page allocation: %llu cycles", page_cnt,
+           (unsigned long long) (cycles / ROUNDS));
+    }
+
+  for (i = 1; i < FRAG_PAGES; i += 2)
+    palloc_free_page (pages[i]);
+  pass ();
+}
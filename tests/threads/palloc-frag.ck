@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $page_cnt (1, 2, 4, 8, 16, 32) {
+    fail "missing $page_cnt-page latency in output"
+      unless grep (/^\(palloc-frag\) $page_cnt-page allocation: \d+ cycles$/,
+		   @output);
+}
+fail "missing PASS in output"
+  unless grep ($_ eq '(palloc-frag) PASS', @output);
+
+pass;
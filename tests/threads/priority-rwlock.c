@@ -0,0 +1,60 @@
+/* Checks writer preference and priority donation in
+   readers-writer locks.
+
+   The main thread holds a readers-writer lock for reading.  A
+   higher-priority writer then waits for it, and an even higher
+   priority reader arrives after the writer.  The reader must
+   wait behind the writer rather than join the main thread, and
+   must donate its priority to the writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread_func;
+static thread_func reader_thread_func;
+
+void
+test_priority_rwlock (void) 
+{
+  struct rwlock rw;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw);
+  rwlock_acquire_read (&rw);
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread_func, &rw);
+  thread_create ("reader", PRI_DEFAULT + 2, reader_thread_func, &rw);
+  msg ("Main releasing read lock.");
+  rwlock_release_read (&rw);
+  msg ("Main finished.");
+}
+
+static void
+writer_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  msg ("Writer waiting.");
+  rwlock_acquire_write (rw);
+  msg ("Writer acquired with priority %d.", thread_get_priority ());
+  rwlock_release_write (rw);
+  msg ("Writer finished.");
+}
+
+static void
+reader_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  msg ("Reader waiting.");
+  rwlock_acquire_read (rw);
+  msg ("Reader acquired.");
+  rwlock_release_read (rw);
+}
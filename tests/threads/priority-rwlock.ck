@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-rwlock) begin
+(priority-rwlock) Writer waiting.
+(priority-rwlock) Reader waiting.
+(priority-rwlock) Main releasing read lock.
+(priority-rwlock) Writer acquired with priority 33.
+(priority-rwlock) Reader acquired.
+(priority-rwlock) Writer finished.
+(priority-rwlock) Main finished.
+(priority-rwlock) end
+EOF
+pass;
@@ -0,0 +1,141 @@
+/* Stress test for priority-ordered waking with many waiters.
+
+   Hundreds of threads with a spread of priorities, many of them
+   equal, wait on a single semaphore and then on a single
+   condition variable.  They must wake strictly by priority, in
+   the order they started waiting among equal priorities.  One
+   waiter holds a lock that a PRI_MAX thread blocks on while all
+   of them are waiting, so it must be the first to wake: its place
+   among the waiters has to follow the donated priority. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define WAITER_CNT 300
+#define DONATEE 150
+
+struct waiter 
+  {
+    int id;                     /* Index in waiters[]. */
+    int priority;               /* Base priority. */
+  };
+
+static struct waiter waiters[WAITER_CNT];
+static int order[WAITER_CNT];   /* Waiter ids in wake order. */
+static int woken;               /* Number of entries in order[]. */
+
+static struct semaphore sema;
+static struct lock monitor;
+static struct condition cond;
+static struct lock donee_lock;  /* Held by waiters[DONATEE]. */
+static bool use_cond;
+
+static thread_func waiter_thread;
+static thread_func donor_thread;
+static void run_round (const char *kind);
+
+void
+test_priority_waiters (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  lock_init (&monitor);
+  cond_init (&cond);
+  lock_init (&donee_lock);
+  thread_set_priority (PRI_MIN);
+
+  for (i = 0; i < WAITER_CNT; i++) 
+    {
+      waiters[i].id = i;
+      waiters[i].priority = PRI_MIN + 1 + (i * 37) % 40;
+    }
+
+  use_cond = false;
+  run_round ("semaphore");
+  use_cond = true;
+  run_round ("condition");
+}
+
+/* Starts every waiter, makes the donor block on the donatee's
+   lock, then wakes the waiters one at a time and checks the
+   order they woke in. */
+static void
+run_round (const char *kind) 
+{
+  int i;
+
+  woken = 0;
+  for (i = 0; i < WAITER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "waiter %d", i);
+      thread_create (name, waiters[i].priority, waiter_thread, &waiters[i]);
+    }
+  thread_create ("donor", PRI_MAX, donor_thread, NULL);
+
+  for (i = 0; i < WAITER_CNT; i++) 
+    if (use_cond) 
+      {
+        lock_acquire (&monitor);
+        cond_signal (&cond, &monitor);
+        lock_release (&monitor);
+      }
+    else
+      sema_up (&sema);
+
+  if (woken != WAITER_CNT)
+    fail ("%s: %d of %d waiters woke", kind, woken, WAITER_CNT);
+  if (order[0] != DONATEE)
+    fail ("%s: waiter %d woke first instead of donatee %d",
+          kind, order[0], DONATEE);
+  for (i = 2; i < WAITER_CNT; i++) 
+    {
+      struct waiter *a = &waiters[order[i - 1]];
+      struct waiter *b = &waiters[order[i]];
+      if (a->priority < b->priority
+          || (a->priority == b->priority && a->id > b->id))
+        fail ("%s: waiter %d (priority %d) woke before "
+              "waiter %d (priority %d)",
+              kind, a->id, a->priority, b->id, b->priority);
+    }
+  msg ("%s: %d waiters woke in priority order.", kind, WAITER_CNT);
+}
+
+static void
+waiter_thread (void *w_) 
+{
+  struct waiter *w = w_;
+
+  if (w->id == DONATEE)
+    lock_acquire (&donee_lock);
+
+  if (use_cond) 
+    {
+      lock_acquire (&monitor);
+      cond_wait (&cond, &monitor);
+      order[woken++] = w->id;
+      lock_release (&monitor);
+    }
+  else 
+    {
+      sema_down (&sema);
+      order[woken++] = w->id;
+    }
+
+  if (w->id == DONATEE)
+    lock_release (&donee_lock);
+}
+
+static void
+donor_thread (void *aux UNUSED) 
+{
+  lock_acquire (&donee_lock);
+  lock_release (&donee_lock);
+}
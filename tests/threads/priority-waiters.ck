@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-waiters) begin
+(priority-waiters) semaphore: 300 waiters woke in priority order.
+(priority-waiters) condition: 300 waiters woke in priority order.
+(priority-waiters) end
+EOF
+pass;
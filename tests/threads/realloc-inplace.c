@@ -0,0 +1,86 @@
+/* Checks that realloc() resizes blocks without moving them when
+   it can.
+
+   A small block that is resized within its size class must stay
+   put.  A big block that shrinks gives back its last pages, and
+   growing it again should take those same pages back instead of
+   copying the block elsewhere.  The contents must survive each
+   step.  Giving back pages this way is not a free as far as the
+   page allocator's counters are concerned. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+#define SMALL_SIZE 100          /* Initial size of the small block. */
+#define BIG_SIZE 20000          /* Size of the big block, 5 pages. */
+
+/* Returns true if the first SIZE bytes of P hold the pattern
+   that fill() wrote. */
+static bool
+check (const unsigned char *p, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != (unsigned char) (i * 7))
+      return false;
+  return true;
+}
+
+/* Fills the SIZE bytes at P with a pattern. */
+static void
+fill (unsigned char *p, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = i * 7;
+}
+
+void
+test_realloc_inplace (void) 
+{
+  unsigned char *p, *q;
+  uintptr_t orig;
+  long long frees, cur;
+
+  p = malloc (SMALL_SIZE);
+  if (p == NULL)
+    fail ("malloc() failed");
+  fill (p, SMALL_SIZE);
+  orig = (uintptr_t) p;
+  q = realloc (p, SMALL_SIZE + 20);
+  if ((uintptr_t) q != orig)
+    fail ("small block moved although it still fit");
+  if (!check (q, SMALL_SIZE))
+    fail ("small block contents changed");
+  msg ("small block grew in place.");
+  free (q);
+
+  p = malloc (BIG_SIZE);
+  if (p == NULL)
+    fail ("malloc() failed");
+  fill (p, BIG_SIZE);
+  orig = (uintptr_t) p;
+  frees = palloc_stats (0)->frees;
+  cur = palloc_stats (0)->cur;
+  q = realloc (p, BIG_SIZE / 2);
+  if ((uintptr_t) q != orig)
+    fail ("big block moved when it shrank");
+  if (palloc_stats (0)->frees != frees)
+    fail ("shrinking the big block was counted as a free");
+  if (palloc_stats (0)->cur != cur - 2)
+    fail ("kernel pool has %lld pages in use after shrinking, expected %lld",
+          palloc_stats (0)->cur, cur - 2);
+  q = realloc (q, BIG_SIZE);
+  if ((uintptr_t) q != orig)
+    fail ("big block moved when it grew back into its own pages");
+  if (!check (q, BIG_SIZE / 2))
+    fail ("big block contents changed");
+  msg ("big block shrank and grew in place.");
+  free (q);
+}
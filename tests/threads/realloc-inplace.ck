@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(realloc-inplace) begin
+(realloc-inplace) small block grew in place.
+(realloc-inplace) big block shrank and grew in place.
+(realloc-inplace) end
+EOF
+pass;
@@ -0,0 +1,165 @@
+/* Checks the supplemental page table's region index.
+
+   Lays out code, data and stack regions the way a process has
+   them, added out of order, and checks spt_range_is_free() and
+   spt_find_region() against ranges that end right where a region
+   starts, start right where one ends, overlap one or two regions
+   by a page, or cover them entirely.  Then grows the stack down
+   one page at a time, the way stack growth would, until the next
+   page would overlap the data segment, and finally compares
+   spt_range_is_free() with a brute-force scan of the regions for
+   every range of pages in a small window.
+
+   The region index only exists with VM, so other kernels skip
+   the test. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+#ifdef VM
+#define USER_BASE ((uint8_t *) 0x400000)
+#define PAGE(N) (USER_BASE + (N) * PGSIZE)
+#define WINDOW 24               /* Pages in the brute-force window. */
+
+static void expect_free (struct supplemental_page_table *,
+                         int start, int end, bool free);
+static void expect_region (struct supplemental_page_table *,
+                           int page, int start);
+static bool naive_is_free (struct supplemental_page_table *,
+                           int start, int end);
+
+void
+test_spt_regions (void)
+{
+  struct supplemental_page_table spt;
+  int start, end, stack_bottom;
+
+  supplemental_page_table_init (&spt);
+  expect_free (&spt, 0, WINDOW, true);
+  expect_region (&spt, 0, -1);
+
+  /* Code in pages 2..4, data right after it in pages 4..8, and a
+     single stack page at 20. */
+  if (!spt_add_region (&spt, PAGE (20), PAGE (21), VM_REGION_STACK)
+      || !spt_add_region (&spt, PAGE (4), PAGE (8), VM_REGION_DATA)
+      || !spt_add_region (&spt, PAGE (2), PAGE (4), VM_REGION_CODE))
+    fail ("could not add adjacent regions");
+  msg ("added 3 regions.");
+
+  /* Boundaries. */
+  expect_free (&spt, 0, 2, true);
+  expect_free (&spt, 8, 20, true);
+  expect_free (&spt, 21, WINDOW, true);
+  expect_free (&spt, 1, 3, false);
+  expect_free (&spt, 3, 5, false);
+  expect_free (&spt, 7, 9, false);
+  expect_free (&spt, 19, 21, false);
+  expect_free (&spt, 0, WINDOW, false);
+  expect_region (&spt, 1, -1);
+  expect_region (&spt, 2, 2);
+  expect_region (&spt, 3, 2);
+  expect_region (&spt, 4, 4);
+  expect_region (&spt, 7, 4);
+  expect_region (&spt, 8, -1);
+  expect_region (&spt, 20, 20);
+  expect_region (&spt, 21, -1);
+  if (spt_find_region (&spt, PAGE (8) - 1) == NULL
+      || spt_find_region (&spt, PAGE (8) - 1)->start != PAGE (4))
+    fail ("last byte of data is not in the data region");
+  msg ("checked boundaries.");
+
+  /* Overlapping regions are rejected and leave the index alone. */
+  if (spt_add_region (&spt, PAGE (7), PAGE (9), VM_REGION_MMAP)
+      || spt_add_region (&spt, PAGE (0), PAGE (WINDOW), VM_REGION_MMAP)
+      || spt_add_region (&spt, PAGE (3), PAGE (4), VM_REGION_MMAP))
+    fail ("added an overlapping region");
+  if (spt.region_cnt != 3)
+    fail ("%zu regions after failed adds, expected 3", spt.region_cnt);
+  msg ("rejected overlapping regions.");
+
+  /* Grow the stack down until it meets the data segment. */
+  for (stack_bottom = 20; ; stack_bottom--)
+    {
+      struct vm_region *stack = spt_find_region (&spt, PAGE (stack_bottom));
+      if (stack == NULL || stack->kind != VM_REGION_STACK)
+        fail ("lost the stack region at page %d", stack_bottom);
+      if (!spt_range_is_free (&spt, PAGE (stack_bottom - 1),
+                              PAGE (stack_bottom)))
+        break;
+      spt_remove_region (&spt, stack);
+      if (!spt_add_region (&spt, PAGE (stack_bottom - 1), PAGE (21),
+                           VM_REGION_STACK))
+        fail ("could not grow the stack to page %d", stack_bottom - 1);
+    }
+  if (stack_bottom != 8)
+    fail ("stack stopped growing at page %d, expected 8", stack_bottom);
+  expect_region (&spt, 7, 4);
+  expect_region (&spt, 8, 8);
+  msg ("grew the stack down to the data segment.");
+
+  for (start = 0; start < WINDOW; start++)
+    for (end = start + 1; end <= WINDOW; end++)
+      if (spt_range_is_free (&spt, PAGE (start), PAGE (end))
+          != naive_is_free (&spt, start, end))
+        fail ("pages %d..%d: index disagrees with brute force", start, end);
+  spt_remove_region (&spt, spt_find_region (&spt, PAGE (2)));
+  for (start = 0; start < WINDOW; start++)
+    for (end = start + 1; end <= WINDOW; end++)
+      if (spt_range_is_free (&spt, PAGE (start), PAGE (end))
+          != naive_is_free (&spt, start, end))
+        fail ("pages %d..%d: index disagrees with brute force", start, end);
+  msg ("matched brute force on every range.");
+
+  supplemental_page_table_kill (&spt);
+}
+
+/* Fails unless pages START through END - 1 are FREE in SPT. */
+static void
+expect_free (struct supplemental_page_table *spt, int start, int end,
+             bool free)
+{
+  if (spt_range_is_free (spt, PAGE (start), PAGE (end)) != free)
+    fail ("pages %d..%d should be %s", start, end, free ? "free" : "taken");
+}
+
+/* Fails unless page PAGE, and the byte just before its end, lie in
+   the region starting at page START, or in none if START is
+   negative. */
+static void
+expect_region (struct supplemental_page_table *spt, int page, int start)
+{
+  const uint8_t *addrs[2] = { PAGE (page), PAGE (page + 1) - 1 };
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      struct vm_region *r = spt_find_region (spt, addrs[i]);
+      if (start < 0 ? r != NULL : (r == NULL || r->start != PAGE (start)))
+        fail ("page %d found in the wrong region", page);
+    }
+}
+
+/* Returns true if no region in SPT overlaps pages START through
+   END - 1, checking every region in turn. */
+static bool
+naive_is_free (struct supplemental_page_table *spt, int start, int end)
+{
+  size_t i;
+
+  for (i = 0; i < spt->region_cnt; i++)
+    if ((uint8_t *) spt->regions[i].start < PAGE (end)
+        && (uint8_t *) spt->regions[i].end > PAGE (start))
+      return false;
+  return true;
+}
+#else /* !VM */
+void
+test_spt_regions (void)
+{
+  msg ("skipped: needs a kernel built with VM.");
+}
+#endif /* VM */
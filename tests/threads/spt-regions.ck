@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(spt-regions) begin
+(spt-regions) added 3 regions.
+(spt-regions) checked boundaries.
+(spt-regions) rejected overlapping regions.
+(spt-regions) grew the stack down to the data segment.
+(spt-regions) matched brute force on every range.
+(spt-regions) end
+EOF
+(spt-regions) begin
+(spt-regions) skipped: needs a kernel built with VM.
+(spt-regions) end
+EOF
+pass;
@@ -0,0 +1,79 @@
+/* Measures context switch throughput.
+
+   Like sema_self_test(), makes control "ping-pong" between a
+   pair of threads through two semaphores, but keeps going for
+   one second of timer ticks and reports how many context
+   switches per second that took.  Each round trip is two
+   switches.  Boot with "-o no-fast-switch" to measure the full
+   intr_frame switch path for comparison. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+struct pingpong 
+  {
+    struct semaphore ping;      /* Upped by main thread. */
+    struct semaphore pong;      /* Upped by helper thread. */
+    struct semaphore done;      /* Upped when helper exits. */
+    bool stop;                  /* Set to make the helper exit. */
+  };
+
+static thread_func pingpong_thread;
+
+void
+test_switch_pingpong (void) 
+{
+  struct pingpong pp;
+  int64_t start, elapsed;
+  long long trips = 0;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  sema_init (&pp.done, 0);
+  pp.stop = false;
+  thread_create ("pingpong", PRI_DEFAULT, pingpong_thread, &pp);
+
+  /* Start at a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  start = timer_ticks ();
+  while ((elapsed = timer_elapsed (start)) < TIMER_FREQ) 
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+      trips++;
+    }
+
+  pp.stop = true;
+  sema_up (&pp.ping);
+  sema_down (&pp.done);
+
+  msg ("%s switch path: %lld switches/s",
+       thread_fast_switch ? "fast" : "full",
+       trips * 2 * TIMER_FREQ / elapsed);
+  pass ();
+}
+
+static void
+pingpong_thread (void *pp_) 
+{
+  struct pingpong *pp = pp_;
+
+  for (;;) 
+    {
+      sema_down (&pp->ping);
+      if (pp->stop)
+        break;
+      sema_up (&pp->pong);
+    }
+  sema_up (&pp->done);
+}
@@ -29,6 +29,18 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"priority-waiters", test_priority_waiters},
+    {"priority-rwlock", test_priority_rwlock},
+    {"switch-pingpong", test_switch_pingpong},
+    {"thread-storm", test_thread_storm},
+    {"palloc-frag", test_palloc_frag},
+    {"bitmap-scan", test_bitmap_scan},
+    {"alloc-stats", test_alloc_stats},
+    {"realloc-inplace", test_realloc_inplace},
+    {"memcpy-bench", test_memcpy_bench},
+    {"mm-pingpong", test_mm_pingpong},
+    {"tlb-batch", test_tlb_batch},
+    {"spt-regions", test_spt_regions},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -23,6 +23,18 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_priority_waiters;
+extern test_func test_priority_rwlock;
+extern test_func test_switch_pingpong;
+extern test_func test_thread_storm;
+extern test_func test_palloc_frag;
+extern test_func test_bitmap_scan;
+extern test_func test_alloc_stats;
+extern test_func test_realloc_inplace;
+extern test_func test_memcpy_bench;
+extern test_func test_mm_pingpong;
+extern test_func test_tlb_batch;
+extern test_func test_spt_regions;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -0,0 +1,57 @@
+/* Measures thread creation and exit throughput.
+
+   Creates short-lived threads back to back for one second of
+   timer ticks, waiting for each one to run before creating the
+   next, and reports how many were created per second.  Every
+   thread that exits leaves its page to the reaper, so after the
+   first few rounds each thread_create() should be served from
+   the thread cache rather than the page allocator; the cache
+   counters in the statistics printed at power off show how
+   often that happened. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func storm_thread;
+
+void
+test_thread_storm (void) 
+{
+  struct semaphore done;
+  int64_t start, elapsed;
+  long long created = 0;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  /* Start at a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  start = timer_ticks ();
+  while ((elapsed = timer_elapsed (start)) < TIMER_FREQ) 
+    {
+      tid_t tid = thread_create ("storm", PRI_DEFAULT, storm_thread, &done);
+      ASSERT (tid != TID_ERROR);
+      sema_down (&done);
+      created++;
+    }
+
+  msg ("%lld threads/s", created * TIMER_FREQ / elapsed);
+  pass ();
+}
+
+static void
+storm_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+
+  sema_up (done);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing creation rate in output"
+  unless grep (/^\(thread-storm\) \d+ threads\/s$/, @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(thread-storm) PASS', @output);
+
+pass;
@@ -0,0 +1,110 @@
+/* Checks that pml4_clear_range() and pml4_protect_range() leave
+   no stale TLB entries behind.
+
+   Maps a run of user pages that crosses a page table boundary,
+   reads each one so that the TLB caches its translation, clears
+   the range, and maps the same pages to different frames.
+   Reading them again must find the new frames' contents, not
+   the old ones.  A short run is invalidated page by page and a
+   long one by reloading CR3.  Then makes the pages read-only,
+   checks their entries, makes them writable again, and writes
+   to them, which would fault on a stale read-only entry. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define PAGE_CNT 64             /* Pages mapped, above TLB_BATCH_MAX. */
+#define SHORT_CNT 16            /* Pages in the short run. */
+
+/* Eight pages below a 2 MB boundary. */
+#define USER_BASE ((uint8_t *) 0x10200000 - 8 * PGSIZE)
+
+static uint8_t *frames[2][PAGE_CNT];
+
+static void map_pages (uint64_t *pml4, int set, int cnt);
+static void check_pages (int set, int cnt);
+
+void
+test_tlb_batch (void) 
+{
+  uint64_t *pml4 = pml4_create ();
+  int i, set, cnt;
+
+  if (pml4 == NULL)
+    fail ("pml4_create failed");
+  for (set = 0; set < 2; set++)
+    for (i = 0; i < PAGE_CNT; i++) 
+      {
+        frames[set][i] = palloc_get_page (PAL_USER);
+        if (frames[set][i] == NULL)
+          fail ("out of user pages");
+        frames[set][i][0] = set * PAGE_CNT + i;
+      }
+  pml4_activate (pml4);
+
+  for (cnt = SHORT_CNT; cnt <= PAGE_CNT; cnt += PAGE_CNT - SHORT_CNT) 
+    {
+      map_pages (pml4, 0, cnt);
+      check_pages (0, cnt);
+      pml4_clear_range (pml4, USER_BASE, cnt, NULL);
+      for (i = 0; i < cnt; i++)
+        if (pml4_get_page (pml4, USER_BASE + i * PGSIZE) != NULL)
+          fail ("page %d still mapped after clearing %d pages", i, cnt);
+      map_pages (pml4, 1, cnt);
+      check_pages (1, cnt);
+      msg ("cleared and remapped %d pages.", cnt);
+      pml4_clear_range (pml4, USER_BASE, cnt, NULL);
+    }
+
+  map_pages (pml4, 1, PAGE_CNT);
+  check_pages (1, PAGE_CNT);
+  pml4_protect_range (pml4, USER_BASE, PAGE_CNT, false, NULL);
+  for (i = 0; i < PAGE_CNT; i++)
+    if (is_writable (pml4e_walk (pml4, (uint64_t) (USER_BASE + i * PGSIZE),
+                                 false)))
+      fail ("page %d still writable", i);
+  pml4_protect_range (pml4, USER_BASE, PAGE_CNT, true, NULL);
+  for (i = 0; i < PAGE_CNT; i++)
+    USER_BASE[i * PGSIZE] = i;
+  for (i = 0; i < PAGE_CNT; i++)
+    if (frames[1][i][0] != i)
+      fail ("write to page %d went astray", i);
+  msg ("protected and unprotected %d pages.", PAGE_CNT);
+
+  /* Destroying the page map frees the second set of frames. */
+  pml4_activate (NULL);
+  pml4_destroy (pml4);
+  for (i = 0; i < PAGE_CNT; i++)
+    palloc_free_page (frames[0][i]);
+}
+
+/* Maps the first CNT user pages at USER_BASE in PML4 to frames
+   from SET. */
+static void
+map_pages (uint64_t *pml4, int set, int cnt) 
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (!pml4_set_page (pml4, USER_BASE + i * PGSIZE, frames[set][i], true))
+      fail ("could not map page %d", i);
+}
+
+/* Reads the first CNT user pages at USER_BASE and checks that
+   they hold the frames from SET. */
+static void
+check_pages (int set, int cnt) 
+{
+  volatile uint8_t *p;
+  int i;
+
+  for (i = 0; i < cnt; i++) 
+    {
+      p = USER_BASE + i * PGSIZE;
+      if (*p != (uint8_t) (set * PAGE_CNT + i))
+        fail ("page %d reads %d, expected %d", i, *p, set * PAGE_CNT + i);
+    }
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(tlb-batch) begin
+(tlb-batch) cleared and remapped 16 pages.
+(tlb-batch) cleared and remapped 64 pages.
+(tlb-batch) protected and unprotected 64 pages.
+(tlb-batch) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Checks that anonymous pages swapped out before fork are shared
+ * with the child through the swap disk.
+ * For this test, Pintos memory size is 10MB, so most of the chunk
+ * is in swap when the process forks.  The child reads every page
+ * back, then writes over half of them; the parent checks that its
+ * own pages did not change. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define ONE_MB (1 << 20) // 1MB
+#define CHUNK_SIZE (16*ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+#define CHILD_EXIT 81
+
+static char big_chunks[CHUNK_SIZE];
+
+/* Returns the value page I holds after the child's writes, in the
+ * child if IN_CHILD, or else in the parent. */
+static char
+expected (size_t i, bool in_child)
+{
+	return in_child && i % 2 ? (char) (i ^ 0x55) : (char) i;
+}
+
+/* Fails unless every page holds its expected value. */
+static void
+check_pages (bool in_child)
+{
+	size_t i;
+
+	for (i = 0 ; i < PAGE_COUNT ; i++)
+		if (big_chunks[i * PAGE_SIZE] != expected (i, in_child))
+			fail ("page %zu is inconsistent", i);
+}
+
+void
+test_main (void)
+{
+	size_t i;
+	pid_t child;
+
+	for (i = 0 ; i < PAGE_COUNT ; i++)
+		big_chunks[i * PAGE_SIZE] = (char) i;
+	msg ("wrote %d pages", PAGE_COUNT);
+
+	child = fork ("swap-share");
+	if (child == 0) {
+		check_pages (false);
+		msg ("child read the parent's pages");
+		for (i = 1 ; i < PAGE_COUNT ; i += 2)
+			big_chunks[i * PAGE_SIZE] = (char) (i ^ 0x55);
+		check_pages (true);
+		msg ("child wrote over half of them");
+		exit (CHILD_EXIT);
+	}
+
+	CHECK (wait (child) == CHILD_EXIT, "wait for child");
+	check_pages (false);
+	msg ("parent's pages are unchanged");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-share) begin
+(swap-share) wrote 4096 pages
+(swap-share) child read the parent's pages
+(swap-share) child wrote over half of them
+(swap-share) wait for child
+(swap-share) parent's pages are unchanged
+(swap-share) end
+EOF
+pass;
@@ -51,6 +51,9 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* -sched-trace: Dump scheduler accounting and trace at power off? */
+static bool dump_sched_trace;
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
@@ -94,6 +97,7 @@ main (void) {
 
 	/* Initialize interrupt handlers. */
 	intr_init ();
+	register_alloc_inspect_intr ();
 	timer_init ();
 	kbd_init ();
 	input_init ();
@@ -103,6 +107,8 @@ main (void) {
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
+	if (palloc_prezero)
+		palloc_start_prezero ();
 	serial_init_queue ();
 	timer_calibrate ();
 
@@ -150,13 +156,33 @@ paging_init (uint64_t mem_end) {
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = (uint64_t) &start;
+	uint64_t text_end = (uint64_t) &_end_kernel_text;
+
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
 	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
 		uint64_t va = (uint64_t) ptov(pa);
 
-		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+		// Use a 2 MB page for each whole, aligned 2 MB region that
+		// does not hold kernel text, which is mapped read-only page
+		// by page.  This saves a page table per 2 MB and lets one
+		// TLB entry cover the whole region.  The first 2 MB stay on
+		// 4 kB pages: they hold the VGA and ROM hole at 0xa0000,
+		// whose memory type differs from RAM's, and a large page
+		// that spans more than one memory type is undefined.  Above
+		// it, everything up to mem_end is RAM.
+		if (pa >= LARGE_PGSIZE && pa % LARGE_PGSIZE == 0
+				&& pa + LARGE_PGSIZE <= mem_end
+				&& (va + LARGE_PGSIZE <= text_start || va >= text_end)) {
+			if ((pte = pml4_pde_walk (pml4, va, 1)) != NULL)
+				*pte = pa | PTE_P | PTE_W | PTE_PS | PTE_G;
+			pa += LARGE_PGSIZE - PGSIZE;
+			continue;
+		}
+
+		perm = PTE_P | PTE_W | PTE_G;
+		if (text_start <= va && va < text_end)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
@@ -165,6 +191,7 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+	mmu_init ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -221,6 +248,16 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-sched-trace"))
+			dump_sched_trace = true;
+		else if (!strcmp (name, "-no-fast-switch"))
+			thread_fast_switch = false;
+		else if (!strcmp (name, "-prezero"))
+			palloc_prezero = true;
+		else if (!strcmp (name, "-pcid"))
+			mmu_pcid = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -326,6 +363,11 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -tickless          Stop the periodic timer tick while idle.\n"
+			"  -sched-trace       Dump scheduler trace when powering off.\n"
+			"  -no-fast-switch    Save a full intr_frame on every switch.\n"
+			"  -prezero           Zero free pages in the background.\n"
+			"  -pcid              Keep user TLB entries across switches.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -354,6 +396,10 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	if (dump_sched_trace)
+		thread_print_trace ();
+	palloc_print_stats ();
+	malloc_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
@@ -361,5 +407,13 @@ print_stats (void) {
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	mmu_print_stats ();
+	process_print_stats ();
+#endif
+#ifdef VM
+	vm_print_stats ();
+#endif
+#ifdef MALLOC_DEBUG
+	malloc_print_leaks ();
 #endif
 }
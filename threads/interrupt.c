@@ -344,6 +344,11 @@ intr_handler (struct intr_frame *frame) {
 
 		in_external_intr = true;
 		yield_on_return = false;
+
+		/* Bring the tick count up to date if the CPU was woken
+		   out of a tickless idle period by another device. */
+		if (frame->vec_no != 0x20)
+			timer_irq_enter ();
 	}
 
 	/* Invoke the interrupt's handler. */
@@ -370,7 +375,7 @@ intr_handler (struct intr_frame *frame) {
 		pic_end_of_interrupt (frame->vec_no);
 
 		if (yield_on_return)
-			thread_yield ();
+			thread_preempt ();
 	}
 }
 
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,16 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Each descriptor, and the big blocks together, keep counts of
+   blocks allocated and freed.  When the kernel is built with
+   MALLOC_DEBUG (run "make MALLOC_DEBUG=1"), every block also
+   starts with a tag that records the return address of the
+   caller that allocated it and links the block into a list of
+   live blocks, which power_off() reports as leaks, grouped by
+   caller.  The "backtrace" utility translates the addresses into
+   function names. */
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +50,8 @@ struct desc {
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+	size_t arena_cnt;           /* Number of arenas. */
+	struct alloc_stats stats;   /* Blocks allocated and freed. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -61,6 +73,28 @@ struct block {
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Pages allocated and freed as big blocks, protected by
+   disabling interrupts. */
+static struct alloc_stats big_stats;
+
+#ifdef MALLOC_DEBUG
+/* Allocation tag, in front of every block handed out. */
+struct tag {
+	struct list_elem elem;      /* Element in live_blocks. */
+	void *caller;               /* Return address of the allocator. */
+	size_t size;                /* Requested size in bytes. */
+};
+
+/* Blocks that have been allocated and not yet freed, protected
+   by disabling interrupts so that a panic can still report them. */
+static struct list live_blocks;
+#endif
+
+static void *malloc_from (size_t size, void *caller);
+static void *block_alloc (size_t size);
+static void block_free (void *);
+static size_t usable_size (void *block);
+static bool resize_in_place (void *block, size_t new_size);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -77,12 +111,49 @@ malloc_init (void) {
 		list_init (&d->free_list);
 		lock_init (&d->lock);
 	}
+#ifdef MALLOC_DEBUG
+	list_init (&live_blocks);
+#endif
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	return malloc_from (size, __builtin_return_address (0));
+}
+
+/* Obtains and returns a new block of at least SIZE bytes on
+   behalf of CALLER, tagging it with CALLER in MALLOC_DEBUG
+   builds.
+   Returns a null pointer if memory is not available. */
+static void *
+malloc_from (size_t size, void *caller UNUSED) {
+#ifdef MALLOC_DEBUG
+	enum intr_level old_level;
+	struct tag *t;
+
+	if (size == 0)
+		return NULL;
+	t = block_alloc (sizeof *t + size);
+	if (t == NULL)
+		return NULL;
+	t->caller = caller;
+	t->size = size;
+	old_level = intr_disable ();
+	list_push_back (&live_blocks, &t->elem);
+	intr_set_level (old_level);
+	return t + 1;
+#else
+	return block_alloc (size);
+#endif
+}
+
+/* Obtains and returns a new block of at least SIZE bytes from
+   the descriptor for SIZE, or as a big block.
+   Returns a null pointer if memory is not available. */
+static void *
+block_alloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
@@ -100,7 +171,15 @@ malloc (size_t size) {
 		/* SIZE is too big for any descriptor.
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+		enum intr_level old_level;
+
 		a = palloc_get_multiple (0, page_cnt);
+		old_level = intr_disable ();
+		if (a != NULL)
+			alloc_stats_alloc (&big_stats, page_cnt);
+		else
+			big_stats.fails++;
+		intr_set_level (old_level);
 		if (a == NULL)
 			return NULL;
 
@@ -121,9 +200,11 @@ malloc (size_t size) {
 		/* Allocate a page. */
 		a = palloc_get_page (0);
 		if (a == NULL) {
+			d->stats.fails++;
 			lock_release (&d->lock);
 			return NULL;
 		}
+		d->arena_cnt++;
 
 		/* Initialize arena and add its blocks to the free list. */
 		a->magic = ARENA_MAGIC;
@@ -139,6 +220,7 @@ malloc (size_t size) {
 	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
 	a = block_to_arena (b);
 	a->free_cnt--;
+	alloc_stats_alloc (&d->stats, 1);
 	lock_release (&d->lock);
 	return b;
 }
@@ -156,13 +238,14 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = malloc_from (size, __builtin_return_address (0));
 	if (p != NULL)
 		memset (p, 0, size);
 
 	return p;
 }
 
+#ifndef MALLOC_DEBUG
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) {
@@ -172,9 +255,68 @@ block_size (void *block) {
 
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
+#endif
+
+/* Returns the number of bytes of BLOCK, which was returned by
+   malloc(), that its owner may use. */
+static size_t
+usable_size (void *block) {
+#ifdef MALLOC_DEBUG
+	return ((struct tag *) block - 1)->size;
+#else
+	return block_size (block);
+#endif
+}
+
+/* Tries to resize BLOCK, which was returned by malloc(), to
+   NEW_SIZE bytes without moving it.  A block from a descriptor
+   can stay where it is as long as NEW_SIZE fits in it.  A big
+   block gives back the pages it no longer needs when it shrinks
+   and takes the pages that follow it, if they are free, when it
+   grows.  Returns true if successful, false if BLOCK has to
+   move. */
+static bool
+resize_in_place (void *block, size_t new_size) {
+	struct block *b = block;
+	size_t size = new_size;
+	struct arena *a;
+	size_t page_cnt;
+	enum intr_level old_level;
+
+#ifdef MALLOC_DEBUG
+	struct tag *t = (struct tag *) block - 1;
+	b = (struct block *) t;
+	size += sizeof *t;
+#endif
+
+	a = block_to_arena (b);
+	if (a->desc != NULL) {
+		if (size > a->desc->block_size)
+			return false;
+	} else {
+		page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+		if (page_cnt > a->free_cnt) {
+			if (!palloc_extend (a, a->free_cnt, page_cnt))
+				return false;
+		} else
+			palloc_shrink (a, a->free_cnt, page_cnt);
+
+		old_level = intr_disable ();
+		alloc_stats_resize (&big_stats,
+				(long long) page_cnt - (long long) a->free_cnt);
+		intr_set_level (old_level);
+		a->free_cnt = page_cnt;
+	}
+
+#ifdef MALLOC_DEBUG
+	t->size = new_size;
+#endif
+	return true;
+}
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
-   moving it in the process.
+   moving it in the process.  The block stays where it is if it
+   can be resized in place.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
@@ -184,10 +326,12 @@ realloc (void *old_block, size_t new_size) {
 	if (new_size == 0) {
 		free (old_block);
 		return NULL;
+	} else if (old_block != NULL && resize_in_place (old_block, new_size)) {
+		return old_block;
 	} else {
-		void *new_block = malloc (new_size);
+		void *new_block = malloc_from (new_size, __builtin_return_address (0));
 		if (old_block != NULL && new_block != NULL) {
-			size_t old_size = block_size (old_block);
+			size_t old_size = usable_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
 			free (old_block);
@@ -200,6 +344,23 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
+#ifdef MALLOC_DEBUG
+	if (p != NULL) {
+		struct tag *t = (struct tag *) p - 1;
+		enum intr_level old_level = intr_disable ();
+
+		list_remove (&t->elem);
+		intr_set_level (old_level);
+		p = t;
+	}
+#endif
+	block_free (p);
+}
+
+/* Returns block P, which was obtained from block_alloc(), to its
+   descriptor or, if it is a big block, to the page allocator. */
+static void
+block_free (void *p) {
 	if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
@@ -218,6 +379,8 @@ free (void *p) {
 			/* Add block to free list. */
 			list_push_front (&d->free_list, &b->free_elem);
 
+			alloc_stats_free (&d->stats, 1);
+
 			/* If the arena is now entirely unused, free it. */
 			if (++a->free_cnt >= d->blocks_per_arena) {
 				size_t i;
@@ -228,17 +391,176 @@ free (void *p) {
 					list_remove (&b->free_elem);
 				}
 				palloc_free_page (a);
+				d->arena_cnt--;
 			}
 
 			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
+			enum intr_level old_level = intr_disable ();
+			alloc_stats_free (&big_stats, a->free_cnt);
+			intr_set_level (old_level);
 			palloc_free_multiple (a, a->free_cnt);
 			return;
 		}
 	}
 }
 
+/* Prints the counters in S, labeled with NAME and followed by
+   EXTRA. */
+static void
+print_alloc_stats (const char *name, const struct alloc_stats *s,
+		const char *extra) {
+	printf ("Malloc: %s: %lld in use%s, %lld peak, %lld allocs, "
+			"%lld frees, %lld failures\n",
+			name, s->cur, extra, s->peak, s->allocs, s->frees, s->fails);
+}
+
+/* Prints the counters of each descriptor that has been used and
+   of big blocks. */
+void
+malloc_print_stats (void) {
+	char name[32], extra[32];
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->stats.allocs > 0 || d->stats.fails > 0) {
+			snprintf (name, sizeof name, "%zu-byte blocks", d->block_size);
+			snprintf (extra, sizeof extra, " (%zu arenas)", d->arena_cnt);
+			print_alloc_stats (name, &d->stats, extra);
+		}
+	if (big_stats.allocs > 0 || big_stats.fails > 0)
+		print_alloc_stats ("big block pages", &big_stats, "");
+}
+
+#ifdef MALLOC_DEBUG
+/* A call site with allocations outstanding. */
+struct leak_site {
+	void *caller;               /* Return address of the allocator. */
+	size_t cnt;                 /* Number of allocations. */
+	size_t size;                /* Total bytes or pages. */
+};
+
+/* Call sites found so far by leak_add().  A report prints at
+   most LEAK_SITES_MAX of them; the rest are lumped together. */
+#define LEAK_SITES_MAX 64
+static struct leak_site leak_sites[LEAK_SITES_MAX + 1];
+static size_t leak_site_cnt;
+
+/* Counts an outstanding allocation of SIZE bytes or pages by
+   CALLER. */
+static void
+leak_add (void *caller, size_t size) {
+	struct leak_site *s;
+
+	for (s = leak_sites; s < leak_sites + leak_site_cnt; s++)
+		if (s->caller == caller)
+			break;
+	if (s == leak_sites + leak_site_cnt) {
+		if (leak_site_cnt == LEAK_SITES_MAX) {
+			s = &leak_sites[LEAK_SITES_MAX];
+			caller = NULL;
+		} else
+			leak_site_cnt++;
+		s->caller = caller;
+	}
+	s->cnt++;
+	s->size += size;
+}
+
+/* Prints the call sites collected by leak_add(), measuring them
+   in UNITS, and forgets them. */
+static void
+leak_print (const char *what, const char *units) {
+	struct leak_site *s;
+
+	for (s = leak_sites; s <= leak_sites + LEAK_SITES_MAX; s++) {
+		if (s->cnt == 0)
+			continue;
+		if (s->caller != NULL)
+			printf ("Leak: %s from %p: %zu, %zu %s\n",
+					what, s->caller, s->cnt, s->size, units);
+		else
+			printf ("Leak: %s from other callers: %zu, %zu %s\n",
+					what, s->cnt, s->size, units);
+	}
+	memset (leak_sites, 0, sizeof leak_sites);
+	leak_site_cnt = 0;
+}
+
+/* Prints the blocks and pages that are still allocated, grouped
+   by the caller that allocated them.  Not everything listed is a
+   leak, since the kernel is still running, but a new entry, or
+   one that grows from run to run, usually is. */
+void
+malloc_print_leaks (void) {
+	enum intr_level old_level = intr_disable ();
+	struct list_elem *e;
+
+	for (e = list_begin (&live_blocks); e != list_end (&live_blocks);
+			e = list_next (e)) {
+		struct tag *t = list_entry (e, struct tag, elem);
+		leak_add (t->caller, t->size);
+	}
+	intr_set_level (old_level);
+	leak_print ("blocks", "bytes");
+
+	old_level = intr_disable ();
+	palloc_for_each_owner (leak_add);
+	intr_set_level (old_level);
+	leak_print ("page groups", "pages");
+}
+#endif
+
+/* Returns counter number IDX of S, in the order that struct
+   alloc_stats declares them, or -1 if IDX is out of range. */
+static long long
+alloc_stats_get (const struct alloc_stats *s, uint64_t idx) {
+	switch (idx) {
+		case 0: return s->cur;
+		case 1: return s->peak;
+		case 2: return s->allocs;
+		case 3: return s->frees;
+		case 4: return s->fails;
+		default: return -1;
+	}
+}
+
+static void
+inspect_palloc (struct intr_frame *f) {
+	if (f->R.rdx <= 1)
+		f->R.rax = alloc_stats_get (palloc_stats (f->R.rdx ? PAL_USER : 0),
+				f->R.rcx);
+	else
+		f->R.rax = -1;
+}
+
+static void
+inspect_malloc (struct intr_frame *f) {
+	if (f->R.rdx < desc_cnt)
+		f->R.rax = alloc_stats_get (&descs[f->R.rdx].stats, f->R.rcx);
+	else if (f->R.rdx == desc_cnt)
+		f->R.rax = alloc_stats_get (&big_stats, f->R.rcx);
+	else
+		f->R.rax = -1;
+}
+
+/* Tool for testing allocator counters. Calling this function via
+ * int 0x45 and int 0x46.
+ * Input:
+ *   @RDX - int 0x45: 0 for the kernel pool, 1 for the user pool.
+ *          int 0x46: index of the malloc() size class, smallest
+ *          first, or the number of size classes for big blocks.
+ *   @RCX - Counter: 0 current, 1 peak, 2 allocs, 3 frees,
+ *          4 failures.
+ * Output:
+ *   @RAX - Value of the counter, or -1 for a bad input. */
+void
+register_alloc_inspect_intr (void) {
+	intr_register_int (0x45, 3, INTR_OFF, inspect_palloc, "Inspect Palloc Counters");
+	intr_register_int (0x46, 3, INTR_OFF, inspect_malloc, "Inspect Malloc Counters");
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
@@ -1,13 +1,46 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdio.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* CR0, CR4 and CR3 bits. */
+#define CR0_WP (1 << 16)                /* Kernel obeys read-only pages. */
+#define CR4_PGE (1 << 7)                /* Enable global pages. */
+#define CR4_PCIDE (1 << 17)             /* Enable PCIDs. */
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep the PCID's TLB entries. */
+
+/* CPUID leaf 1 feature bits. */
+#define CPUID_EDX_PGE (1 << 13)
+#define CPUID_ECX_PCID (1 << 17)
+
+/* Tag TLB entries with process-context identifiers, if the CPU
+   supports them?  Set by the -pcid option. */
+bool mmu_pcid;
+
+/* Each pml4 that has been active gets a PCID, so that its TLB
+   entries can survive switches to other address spaces.  PCID 0
+   belongs to base_pml4; the others are handed out round-robin,
+   and the TLB entries of a PCID are flushed when it changes
+   hands.  Protected by disabling interrupts. */
+#define PCID_CNT 64
+static bool pcid_enabled;               /* CR4.PCIDE is set. */
+static uint64_t *pcid_owner[PCID_CNT];  /* pml4 that has each PCID. */
+static bool pcid_stale[PCID_CNT];       /* Flush at next activation? */
+static unsigned pcid_next = 1;          /* Next PCID to hand out. */
+
+/* Statistics. */
+static long long cr3_loads;             /* Number of CR3 loads. */
+static long long cr3_skips;             /* Activations that needed none. */
+static long long tlb_page_flushes;      /* Pages invalidated by batches. */
+static long long tlb_full_flushes;      /* Batches that reloaded CR3. */
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -23,6 +56,8 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		if (pdp[idx] & PTE_PS)
+			return &pdp[idx];
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -60,7 +95,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a 2 MB page, returns the address of the page
+ * directory entry that maps it, which has PTE_PS set. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -88,6 +125,44 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the table that entry IDX of TABLE points to, creating
+ * it first if it is not present and CREATE is true.  Returns a
+ * null pointer if it is not present and CREATE is false, or if
+ * memory allocation fails. */
+static uint64_t *
+next_table (uint64_t *table, int idx, int create) {
+	if (!(table[idx] & PTE_P)) {
+		uint64_t *new_page;
+
+		if (!create)
+			return NULL;
+		new_page = palloc_get_page (PAL_ZERO);
+		if (new_page == NULL)
+			return NULL;
+		table[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (table[idx]));
+}
+
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, which maps the 2 MB region around VA either
+ * to a page table or, if it has PTE_PS set, directly to a large
+ * page.  If the tables above it are missing, creates them if
+ * CREATE is true, or returns a null pointer otherwise.  Tables
+ * created before an allocation failure are left in place. */
+uint64_t *
+pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *pdp, *pd;
+
+	pdp = next_table (pml4, PML4 (va), create);
+	if (pdp == NULL)
+		return NULL;
+	pd = next_table (pdp, PDPE (va), create);
+	if (pd == NULL)
+		return NULL;
+	return &pd[PDX (va)];
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,10 +197,18 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS) {
+			/* A large page: pass its page directory entry. */
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+					pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -143,7 +226,9 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * A 2 MB page is passed once, as its page directory entry, which
+ * has PTE_PS set. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,7 +254,7 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -185,12 +270,128 @@ pdpe_destroy (uint64_t *pdpe) {
 	palloc_free_page ((void *) pdpe);
 }
 
+/* Returns the index of PML4's PCID, or 0 if it has none. */
+static unsigned
+pcid_find (uint64_t *pml4) {
+	for (unsigned i = 1; i < PCID_CNT; i++)
+		if (pcid_owner[i] == pml4)
+			return i;
+	return 0;
+}
+
+/* Returns the PCID bits to load into CR3 along with PML4,
+ * handing PML4 a PCID if it does not have one.  Asks the CPU to
+ * keep the PCID's TLB entries only if they are known to be
+ * PML4's and up to date.  Must be called with interrupts off. */
+static uint64_t
+pcid_cr3_bits (uint64_t *pml4) {
+	unsigned pcid;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (pml4 == base_pml4)
+		return CR3_NOFLUSH;
+
+	pcid = pcid_find (pml4);
+	if (pcid != 0 && !pcid_stale[pcid])
+		return pcid | CR3_NOFLUSH;
+	if (pcid == 0) {
+		pcid = pcid_next;
+		pcid_next = pcid_next % (PCID_CNT - 1) + 1;
+		pcid_owner[pcid] = pml4;
+	}
+	pcid_stale[pcid] = false;
+	return pcid;
+}
+
+/* Returns true if PML4 is the page map loaded in CR3. */
+static bool
+pml4_is_loaded (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Marks the TLB entries of PML4, which is not loaded, as stale,
+ * if they can have survived under its PCID. */
+static void
+pcid_mark_stale (uint64_t *pml4) {
+	if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		unsigned pcid = pcid_find (pml4);
+		if (pcid != 0)
+			pcid_stale[pcid] = true;
+		intr_set_level (old_level);
+	}
+}
+
+/* Keeps the TLB from using a stale translation for VA in PML4
+ * after its page table entry changed.  If PML4 is not loaded, its
+ * TLB entries can only survive under its PCID, which is then
+ * flushed the next time PML4 is activated. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	if (pml4_is_loaded (pml4))
+		invlpg (va);
+	else
+		pcid_mark_stale (pml4);
+}
+
+/* Initializes B as an empty batch of invalidations for PML4. */
+void
+tlb_batch_init (struct tlb_batch *b, uint64_t *pml4) {
+	b->pml4 = pml4;
+	b->cnt = 0;
+}
+
+/* Queues the TLB entry for VA in B's page map for invalidation
+ * by tlb_batch_flush().  Past TLB_BATCH_MAX pages, only counts
+ * them: the flush then reloads CR3 instead. */
+void
+tlb_batch_add (struct tlb_batch *b, const void *va) {
+	if (b->cnt < TLB_BATCH_MAX)
+		b->va[b->cnt] = (uint64_t) va;
+	b->cnt++;
+}
+
+/* Invalidates the TLB entries queued in B and empties it.  If B's
+ * page map is not loaded, marks its PCID stale instead, as
+ * tlb_invalidate() does.  Reloading CR3 leaves the kernel's
+ * global entries alone, and since it is not asked to keep
+ * entries, it flushes the user entries of the current PCID. */
+void
+tlb_batch_flush (struct tlb_batch *b) {
+	if (b->cnt == 0)
+		return;
+	if (!pml4_is_loaded (b->pml4))
+		pcid_mark_stale (b->pml4);
+	else if (b->cnt > TLB_BATCH_MAX) {
+		enum intr_level old_level = intr_disable ();
+		lcr3 (rcr3 () & ~CR3_NOFLUSH);
+		tlb_full_flushes++;
+		intr_set_level (old_level);
+	} else {
+		for (size_t i = 0; i < b->cnt; i++)
+			invlpg (b->va[i]);
+		tlb_page_flushes += b->cnt;
+	}
+	b->cnt = 0;
+}
+
 /* Destroys pml4e, freeing all the pages it references. */
 void
 pml4_destroy (uint64_t *pml4) {
 	if (pml4 == NULL)
 		return;
 	ASSERT (pml4 != base_pml4);
+	ASSERT (!pml4_is_loaded (pml4));
+
+	/* Give up its PCID.  The next owner's first activation flushes
+	 * whatever TLB entries are left. */
+	if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		unsigned pcid = pcid_find (pml4);
+		if (pcid != 0)
+			pcid_owner[pcid] = NULL;
+		intr_set_level (old_level);
+	}
 
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
@@ -200,10 +401,66 @@ pml4_destroy (uint64_t *pml4) {
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register, or base_pml4 if PD is null.  Does nothing if it is
+ * already loaded.  Kernel mappings are global, so loading CR3
+ * does not flush them, and with PCIDs, neither does it flush
+ * user mappings that are still valid. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	uint64_t cr3;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+
+	old_level = intr_disable ();
+	if (pml4_is_loaded (pml4))
+		cr3_skips++;
+	else {
+		cr3 = vtop (pml4);
+		if (pcid_enabled)
+			cr3 |= pcid_cr3_bits (pml4);
+		lcr3 (cr3);
+		cr3_loads++;
+	}
+	intr_set_level (old_level);
+}
+
+/* Turns on global pages and, if requested with -pcid, PCIDs, as
+ * far as the CPU supports them.  Called once base_pml4, whose
+ * kernel mappings are global, has been loaded. */
+void
+mmu_init (void) {
+	uint32_t a, b, c, d;
+	uint64_t cr4;
+
+#ifdef VM
+	/* Copy-on-write relies on the kernel's writes to user pages,
+	 * as in read(), faulting on read-only mappings too. */
+	lcr0 (rcr0 () | CR0_WP);
+#endif
+
+	cpuid (1, &a, &b, &c, &d);
+	cr4 = rcr4 ();
+	if (d & CPUID_EDX_PGE)
+		cr4 |= CR4_PGE;
+	if (mmu_pcid && (c & CPUID_ECX_PCID)) {
+		/* CR3 must hold PCID 0 when PCIDs are turned on. */
+		ASSERT ((rcr3 () & 0xfff) == 0);
+		cr4 |= CR4_PCIDE;
+		pcid_enabled = true;
+		pcid_owner[0] = base_pml4;
+	}
+	lcr4 (cr4);
+}
+
+/* Prints page map statistics. */
+void
+mmu_print_stats (void) {
+	printf ("MMU: %lld page map loads, %lld skipped%s\n",
+			cr3_loads, cr3_skips, pcid_enabled ? ", PCIDs on" : "");
+	printf ("MMU: %lld pages invalidated in batches, %lld full flushes\n",
+			tlb_page_flushes, tlb_full_flushes);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,8 +473,12 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (LARGE_PTE_ADDR (*pte))
+				+ ((uint64_t) uaddr & (LARGE_PGSIZE - 1));
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -238,8 +499,12 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		bool was_present = (*pte & PTE_P) != 0;
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (was_present)
+			tlb_invalidate (pml4, (uint64_t) upage);
+	}
 	return pte != NULL;
 }
 
@@ -257,11 +522,105 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, (uint64_t) upage);
 	}
 }
 
+/* Calls FUNC on the page table entry of each of the PAGE_CNT
+ * user pages starting at UPAGE that has one, walking down from
+ * PML4 once per page table rather than once per page.  Pages
+ * without a page table are skipped a page table at a time. */
+static void
+range_for_each (uint64_t *pml4, void *upage, size_t page_cnt,
+		void (*func) (uint64_t *pte, uint64_t va, void *aux), void *aux) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t end = va + page_cnt * PGSIZE;
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (page_cnt == 0 || is_user_vaddr ((void *) (end - 1)));
+
+	while (va < end) {
+		uint64_t table_end = (va | (LARGE_PGSIZE - 1)) + 1;
+		uint64_t *pde = pml4_pde_walk (pml4, va, false);
+
+		if (table_end > end)
+			table_end = end;
+		if (pde != NULL && (*pde & PTE_P)) {
+			uint64_t *pt = ptov (PTE_ADDR (*pde));
+
+			ASSERT (!(*pde & PTE_PS));
+			for (; va < table_end; va += PGSIZE)
+				func (&pt[PTX (va)], va, aux);
+		}
+		va = table_end;
+	}
+}
+
+/* range_for_each() helper for pml4_clear_range(). */
+static void
+clear_pte (uint64_t *pte, uint64_t va, void *b) {
+	if (*pte & PTE_P) {
+		*pte &= ~PTE_P;
+		tlb_batch_add (b, (void *) va);
+	}
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+ * present" in PML4, as pml4_clear_page() does for one page.  The
+ * TLB invalidations are queued in B, which the caller must flush,
+ * or, if B is null, carried out before returning. */
+void
+pml4_clear_range (uint64_t *pml4, void *upage, size_t page_cnt,
+		struct tlb_batch *b) {
+	struct tlb_batch local;
+
+	if (b == NULL)
+		tlb_batch_init (b = &local, pml4);
+	ASSERT (b->pml4 == pml4);
+	range_for_each (pml4, upage, page_cnt, clear_pte, b);
+	if (b == &local)
+		tlb_batch_flush (b);
+}
+
+/* range_for_each() auxiliary data for pml4_protect_range(). */
+struct protect_aux {
+	struct tlb_batch *batch;
+	bool rw;
+};
+
+/* range_for_each() helper for pml4_protect_range(). */
+static void
+protect_pte (uint64_t *pte, uint64_t va, void *aux_) {
+	struct protect_aux *aux = aux_;
+	uint64_t old = *pte;
+
+	if (!(old & PTE_P))
+		return;
+	*pte = aux->rw ? old | PTE_W : old & ~(uint64_t) PTE_W;
+	if (*pte != old)
+		tlb_batch_add (aux->batch, (void *) va);
+}
+
+/* Makes the mapped pages among the PAGE_CNT user virtual pages
+ * starting at UPAGE in PML4 read/write if RW is true, read-only
+ * otherwise.  TLB invalidations are handled as in
+ * pml4_clear_range(). */
+void
+pml4_protect_range (uint64_t *pml4, void *upage, size_t page_cnt,
+		bool rw, struct tlb_batch *b) {
+	struct tlb_batch local;
+	struct protect_aux aux;
+
+	if (b == NULL)
+		tlb_batch_init (b = &local, pml4);
+	ASSERT (b->pml4 == pml4);
+	aux.batch = b;
+	aux.rw = rw;
+	range_for_each (pml4, upage, page_cnt, protect_pte, &aux);
+	if (b == &local)
+		tlb_batch_flush (b);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
@@ -283,8 +642,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -309,7 +667,6 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
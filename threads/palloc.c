@@ -2,14 +2,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +27,95 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages,
+   for ORDER from 0 to BUDDY_MAX_ORDER, each aligned to its size
+   relative to the pool's base, on one free list per order.  An
+   allocation takes the smallest block big enough and splits it;
+   freeing a block merges it with its "buddy", the other half of
+   the block of the next order up, for as long as that buddy is
+   free too.  Both are O(log n) in the pool size.  A request for
+   a page count that is not a power of two takes a block of the
+   next power of two and gives back the unused tail at once, so
+   callers free exactly the pages they asked for.
+
+   Each pool also keeps its used_map bitmap, but in debug builds
+   (without NDEBUG) only to cross-check the buddy allocator.
+
+   In front of the buddy allocator, each pool caches up to
+   PCP_HIGH free single pages.  palloc_get_page() and
+   palloc_free_page() work on that cache with interrupts off
+   instead of taking the pool lock, which they need only to
+   refill an empty cache or drain a full one, PCP_BATCH pages at
+   a time.  To the buddy allocator and used_map, cached pages are
+   allocated.
+
+   With the -prezero option, a low-priority "prezero" thread also
+   takes pages from each pool, zeroes them and keeps up to
+   ZEROED_HIGH of them on the side, so that a PAL_ZERO request for
+   a single page can skip the memset.  Zeroed pages go back into
+   circulation whenever a pool runs out.  The thread leaves a pool
+   alone once it is down to PREZERO_MIN_FREE free pages, because
+   the page it is zeroing cannot be given back that way. */
+
+/* Largest block order, in pages: blocks of 1024 pages (4 MB). */
+#define BUDDY_MAX_ORDER 10
+#define BUDDY_ORDERS (BUDDY_MAX_ORDER + 1)
+
+/* Flag in a pool's `orders' entry for the first page of a free
+   block; the low bits hold the block's order. */
+#define BUDDY_FREE 0x80
+
+/* Pages moved between a page cache and the buddy allocator at
+   once, and most pages a page cache holds. */
+#define PCP_BATCH 32
+#define PCP_HIGH (2 * PCP_BATCH)
+
+/* Most pre-zeroed pages kept per pool. */
+#define ZEROED_HIGH 64
+
+/* Fewest free pages a pool must have for the prezero thread to take
+   one.  The page it is zeroing is out of reach of zeroed_flush(), so
+   it must never be the page a request needs. */
+#define PREZERO_MIN_FREE (2 * PCP_BATCH)
+
+/* A free block, stored in its own first page. */
+struct free_block {
+	struct list_elem elem;          /* Element in a free list. */
+};
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t page_cnt;                /* Number of pages in pool. */
+	uint8_t *orders;                /* BUDDY_FREE | order for the first
+	                                   page of each free block, else 0. */
+	struct list free_lists[BUDDY_ORDERS]; /* Free blocks by order. */
+
+	/* Page cache, protected by disabling interrupts. */
+	void *pcp[PCP_HIGH];            /* Free single pages. */
+	size_t pcp_cnt;                 /* Number of pages in pcp. */
+	long long pcp_hits;             /* Single-page gets from the cache. */
+	long long pcp_misses;           /* Single-page gets that refilled. */
+	long long pcp_refills;          /* Batches taken from the buddy pool. */
+	long long pcp_drains;           /* Batches given back to it. */
+
+	/* Pre-zeroed pages, protected by disabling interrupts. */
+	void *zeroed[ZEROED_HIGH];      /* Zero-filled free pages. */
+	size_t zeroed_cnt;              /* Number of pages in zeroed. */
+	long long zeroed_hits;          /* PAL_ZERO pages taken from zeroed. */
+	long long zeroed_misses;        /* PAL_ZERO pages zeroed on demand. */
+
+	/* Protected by disabling interrupts. */
+	struct alloc_stats stats;       /* Pages handed out and freed. */
+#ifdef MALLOC_DEBUG
+	void **owners;                  /* For each allocated page, the
+	                                   caller that allocated it. */
+#endif
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +123,36 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Zero free pages in the background for PAL_ZERO requests? */
+bool palloc_prezero;
+
+/* Wakes the prezero thread when it is waiting for pages to be
+   used up. */
+static struct semaphore prezero_sema;
+static bool prezero_waiting;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void buddy_populate (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t buddy_get (struct pool *, size_t page_cnt);
+static bool buddy_claim (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_put (struct pool *, size_t page_idx, size_t page_cnt);
+static void *pcp_get (struct pool *, bool count);
+static void pcp_put (struct pool *, void *page);
+static void pcp_drain (struct pool *, size_t page_cnt);
+static void *zeroed_get (struct pool *);
+static bool zeroed_flush (struct pool *);
+static void *pool_get (struct pool *, size_t page_cnt);
+static void *get_multiple (enum palloc_flags, size_t page_cnt, void *caller);
+static void account_get (struct pool *, void *pages, size_t page_cnt,
+		void *caller);
+static void account_put (struct pool *, void *pages, size_t page_cnt,
+		bool shrink);
+static void put_multiple (void *pages, size_t page_cnt, bool shrink);
 
 /* multiboot info */
 struct multiboot_info {
@@ -232,6 +343,10 @@ split:
 			}
 		}
 	}
+
+	// Hand the usable pages to the buddy allocators.
+	buddy_populate (&kernel_pool);
+	buddy_populate (&user_pool);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -261,27 +376,7 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
-	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
-
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
-
-	if (pages) {
-		if (flags & PAL_ZERO)
-			memset (pages, 0, PGSIZE * page_cnt);
-	} else {
-		if (flags & PAL_ASSERT)
-			PANIC ("palloc_get: out of pages");
-	}
-
-	return pages;
+	return get_multiple (flags, page_cnt, __builtin_return_address (0));
 }
 
 /* Obtains a single free page and returns its kernel virtual
@@ -293,12 +388,35 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+	return get_multiple (flags, 1, __builtin_return_address (0));
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
+	put_multiple (pages, page_cnt, false);
+}
+
+/* Shrinks the block of PAGE_CNT pages at PAGES, which was
+   obtained from palloc_get_multiple(), to its first NEW_PAGE_CNT
+   pages, giving the rest back to the pool.  Unlike freeing them
+   with palloc_free_multiple(), this is not counted as a free,
+   since the block itself is still in use. */
+void
+palloc_shrink (void *pages, size_t page_cnt, size_t new_page_cnt) {
+	ASSERT (pg_ofs (pages) == 0);
+	ASSERT (new_page_cnt > 0);
+	if (new_page_cnt >= page_cnt)
+		return;
+
+	put_multiple ((uint8_t *) pages + new_page_cnt * PGSIZE,
+			page_cnt - new_page_cnt, true);
+}
+
+/* Returns the PAGE_CNT pages starting at PAGES to their pool,
+   counting them as a free, or as a shrink if SHRINK is true. */
+static void
+put_multiple (void *pages, size_t page_cnt, bool shrink) {
 	struct pool *pool;
 	size_t page_idx;
 
@@ -314,12 +432,125 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 		NOT_REACHED ();
 
 	page_idx = pg_no (pages) - pg_no (pool->base);
+	account_put (pool, pages, page_cnt, shrink);
 
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
-	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+
+	if (page_cnt == 1)
+		pcp_put (pool, pages);
+	else
+		buddy_put (pool, page_idx, page_cnt);
+}
+
+/* Prints the page counts of POOL, which is called NAME. */
+static void
+print_pool_usage (const char *name, const struct pool *pool) {
+	const struct alloc_stats *s = &pool->stats;
+
+	printf ("Palloc: %s pool: %lld of %zu pages in use, %lld peak, "
+			"%lld allocs, %lld frees, %lld failures\n",
+			name, s->cur, pool->page_cnt, s->peak, s->allocs, s->frees,
+			s->fails);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Palloc: kernel pool: %lld hits, %lld misses, "
+			"%lld refills, %lld drains\n",
+			kernel_pool.pcp_hits, kernel_pool.pcp_misses,
+			kernel_pool.pcp_refills, kernel_pool.pcp_drains);
+	printf ("Palloc: user pool: %lld hits, %lld misses, "
+			"%lld refills, %lld drains\n",
+			user_pool.pcp_hits, user_pool.pcp_misses,
+			user_pool.pcp_refills, user_pool.pcp_drains);
+	if (palloc_prezero)
+		printf ("Palloc: prezeroed pages: %lld hits, %lld misses\n",
+				kernel_pool.zeroed_hits + user_pool.zeroed_hits,
+				kernel_pool.zeroed_misses + user_pool.zeroed_misses);
+	print_pool_usage ("kernel", &kernel_pool);
+	print_pool_usage ("user", &user_pool);
+}
+
+/* Returns the allocation counters for the pool that FLAGS
+   selects. */
+const struct alloc_stats *
+palloc_stats (enum palloc_flags flags) {
+	return flags & PAL_USER ? &user_pool.stats : &kernel_pool.stats;
+}
+
+#ifdef MALLOC_DEBUG
+/* Calls FUNC for each group of contiguous allocated pages in
+   either pool that were allocated by the same caller, passing
+   the caller's return address and the number of pages. */
+void
+palloc_for_each_owner (void (*func) (void *caller, size_t page_cnt)) {
+	struct pool *pools[] = {&kernel_pool, &user_pool};
+	size_t i, j, k;
+
+	for (i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *pool = pools[i];
+		for (j = 0; j < pool->page_cnt; j = k) {
+			for (k = j + 1; k < pool->page_cnt; k++)
+				if (pool->owners[k] != pool->owners[j])
+					break;
+			if (pool->owners[j] != NULL)
+				func (pool->owners[j], k - j);
+		}
+	}
+}
+#endif
+
+/* Tries to grow the block of PAGE_CNT pages at PAGES, which was
+   obtained from palloc_get_multiple(), to NEW_PAGE_CNT pages
+   without moving it, by taking the pages that follow it.  The
+   new pages are not cleared, even if the block was obtained
+   with PAL_ZERO.  Returns true if successful, false if any of
+   the pages is in use or past the end of the pool. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_page_cnt) {
+	struct pool *pool;
+	size_t page_idx, extra_cnt;
+	enum intr_level old_level;
+
+	ASSERT (pg_ofs (pages) == 0);
+	ASSERT (page_cnt > 0);
+	if (new_page_cnt <= page_cnt)
+		return true;
+
+	if (page_from_pool (&kernel_pool, pages))
+		pool = &kernel_pool;
+	else if (page_from_pool (&user_pool, pages))
+		pool = &user_pool;
+	else
+		NOT_REACHED ();
+
+	page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+	extra_cnt = new_page_cnt - page_cnt;
+	if (page_idx + extra_cnt > pool->page_cnt)
+		return false;
+
+	if (!buddy_claim (pool, page_idx, extra_cnt)) {
+		/* The pages we want might be sitting in the page cache. */
+		if (pool->pcp_cnt == 0)
+			return false;
+		pcp_drain (pool, PCP_HIGH);
+		if (!buddy_claim (pool, page_idx, extra_cnt))
+			return false;
+	}
+
+	old_level = intr_disable ();
+	alloc_stats_resize (&pool->stats, extra_cnt);
+#ifdef MALLOC_DEBUG
+	size_t i;
+
+	for (i = 0; i < extra_cnt; i++)
+		pool->owners[page_idx + i] = pool->owners[page_idx - 1];
+#endif
+	intr_set_level (old_level);
+	return true;
 }
 
 /* Frees the page at PAGE. */
@@ -336,15 +567,33 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t order_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
+	int order;
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->page_cnt = pgcnt;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	// The buddy allocator's per-page orders follow the bitmap.
+	p->orders = *bm_base;
+	memset (p->orders, 0, pgcnt);
+	for (order = 0; order < BUDDY_ORDERS; order++)
+		list_init (&p->free_lists[order]);
+
+	*bm_base += order_pages;
+
+#ifdef MALLOC_DEBUG
+	// So do the allocating callers of each page.
+	p->owners = *bm_base;
+	memset (p->owners, 0, pgcnt * sizeof *p->owners);
+	*bm_base += DIV_ROUND_UP (pgcnt * sizeof *p->owners, PGSIZE) * PGSIZE;
+#endif
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +605,524 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block in POOL whose first page is PAGE_IDX. */
+static struct free_block *
+block_at (struct pool *pool, size_t page_idx) {
+	return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the first page of BLOCK. */
+static size_t
+block_idx (struct pool *pool, struct free_block *block) {
+	return ((uint8_t *) block - pool->base) / PGSIZE;
+}
+
+/* Puts the block of 2**ORDER pages at PAGE_IDX on POOL's free
+   list for ORDER. */
+static void
+buddy_insert (struct pool *pool, size_t page_idx, int order) {
+	pool->orders[page_idx] = BUDDY_FREE | order;
+	list_push_front (&pool->free_lists[order],
+			&block_at (pool, page_idx)->elem);
+}
+
+/* Takes the free block at PAGE_IDX off its free list. */
+static void
+buddy_remove (struct pool *pool, size_t page_idx) {
+	pool->orders[page_idx] = 0;
+	list_remove (&block_at (pool, page_idx)->elem);
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy for as long as the buddy is free too. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order) {
+	while (order < BUDDY_MAX_ORDER) {
+		size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+		if (buddy + ((size_t) 1 << order) > pool->page_cnt
+				|| pool->orders[buddy] != (BUDDY_FREE | order))
+			break;
+		buddy_remove (pool, buddy);
+		if (buddy < page_idx)
+			page_idx = buddy;
+		order++;
+	}
+	buddy_insert (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, as the largest
+   aligned blocks that cover them.  The caller must hold POOL's
+   lock, as for the other buddy_*() functions. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	while (page_cnt > 0) {
+		int order = 0;
+
+		while (order < BUDDY_MAX_ORDER
+				&& (page_idx & ((size_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		buddy_free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   large enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	struct free_block *block;
+	size_t page_idx;
+	int order = 0, o;
+
+	if (page_cnt == 0 || page_cnt > ((size_t) 1 << BUDDY_MAX_ORDER))
+		return BITMAP_ERROR;
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+
+	/* Find the smallest free block that is big enough. */
+	for (o = order; o < BUDDY_ORDERS; o++)
+		if (!list_empty (&pool->free_lists[o]))
+			break;
+	if (o == BUDDY_ORDERS)
+		return BITMAP_ERROR;
+
+	block = list_entry (list_front (&pool->free_lists[o]),
+			struct free_block, elem);
+	page_idx = block_idx (pool, block);
+	buddy_remove (pool, page_idx);
+
+	/* Split it down to ORDER, freeing the upper halves. */
+	while (o > order) {
+		o--;
+		buddy_insert (pool, page_idx + ((size_t) 1 << o), o);
+	}
+
+	/* Give back the pages past PAGE_CNT. */
+	buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return page_idx;
+}
+
+/* Gives every page marked free in POOL's used_map to its buddy
+   allocator.  Called once, after the usable memory is known. */
+static void
+buddy_populate (struct pool *pool) {
+	size_t start = 0;
+
+	while (start < pool->page_cnt) {
+		size_t end;
+
+		if (bitmap_test (pool->used_map, start)) {
+			start++;
+			continue;
+		}
+		end = start;
+		while (end < pool->page_cnt && !bitmap_test (pool->used_map, end))
+			end++;
+		buddy_free (pool, start, end - start);
+		start = end;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL's buddy allocator
+   under its lock, and returns the index of the first, or
+   BITMAP_ERROR on failure. */
+static size_t
+buddy_get (struct pool *pool, size_t page_cnt) {
+	size_t page_idx;
+
+	lock_acquire (&pool->lock);
+	page_idx = buddy_alloc (pool, page_cnt);
+#ifndef NDEBUG
+	if (page_idx != BITMAP_ERROR) {
+		ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
+#endif
+	lock_release (&pool->lock);
+	return page_idx;
+}
+
+/* Returns the first page of the free block in POOL that contains
+   page PAGE_IDX and stores its order in *ORDER, or returns
+   BITMAP_ERROR if PAGE_IDX is not free.  Free blocks do not
+   overlap, so at most one of the aligned blocks around PAGE_IDX
+   can be free. */
+static size_t
+buddy_find (struct pool *pool, size_t page_idx, int *order) {
+	int o;
+
+	for (o = 0; o < BUDDY_ORDERS; o++) {
+		size_t start = page_idx & ~(((size_t) 1 << o) - 1);
+		if (start + ((size_t) 1 << o) <= pool->page_cnt
+				&& pool->orders[start] == (BUDDY_FREE | o)) {
+			*order = o;
+			return start;
+		}
+	}
+	return BITMAP_ERROR;
+}
+
+/* Allocates exactly the PAGE_CNT pages at PAGE_IDX from POOL's
+   buddy allocator under its lock, if all of them are free, and
+   returns true; otherwise allocates nothing and returns false. */
+static bool
+buddy_claim (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t end = page_idx + page_cnt;
+	size_t i, start;
+	int order;
+
+	lock_acquire (&pool->lock);
+
+	/* Check that free blocks cover the whole range. */
+	for (i = page_idx; i < end; i = start + ((size_t) 1 << order)) {
+		start = buddy_find (pool, i, &order);
+		if (start == BITMAP_ERROR) {
+			lock_release (&pool->lock);
+			return false;
+		}
+	}
+
+	/* Take the blocks, giving back the parts of the first and the
+	   last that stick out of the range.  Those parts lie inside
+	   blocks that are now in use, so they cannot merge back into
+	   the range. */
+	for (i = page_idx; i < end; i = start + ((size_t) 1 << order)) {
+		size_t block_end;
+
+		start = buddy_find (pool, i, &order);
+		block_end = start + ((size_t) 1 << order);
+		buddy_remove (pool, start);
+		buddy_free (pool, start, i - start);
+		if (block_end > end)
+			buddy_free (pool, end, block_end - end);
+	}
+#ifndef NDEBUG
+	ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+#endif
+
+	lock_release (&pool->lock);
+	return true;
+}
+
+/* Frees PAGE_CNT pages at PAGE_IDX to POOL's buddy allocator
+   under its lock. */
+static void
+buddy_put (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	lock_acquire (&pool->lock);
+#ifndef NDEBUG
+	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+#endif
+	buddy_free (pool, page_idx, page_cnt);
+	lock_release (&pool->lock);
+}
+
+/* Takes up to PCP_BATCH single pages from POOL's buddy allocator
+   under one acquisition of its lock and adds them to its page
+   cache. */
+static void
+pcp_refill (struct pool *pool) {
+	void *batch[PCP_BATCH];
+	enum intr_level old_level;
+	size_t cnt = 0, i = 0;
+
+	lock_acquire (&pool->lock);
+	while (cnt < PCP_BATCH) {
+		size_t page_idx = buddy_alloc (pool, 1);
+		if (page_idx == BITMAP_ERROR)
+			break;
+#ifndef NDEBUG
+		ASSERT (!bitmap_test (pool->used_map, page_idx));
+		bitmap_mark (pool->used_map, page_idx);
+#endif
+		batch[cnt++] = pool->base + PGSIZE * page_idx;
+	}
+	lock_release (&pool->lock);
+
+	old_level = intr_disable ();
+	pool->pcp_refills++;
+	while (i < cnt && pool->pcp_cnt < PCP_HIGH)
+		pool->pcp[pool->pcp_cnt++] = batch[i++];
+	intr_set_level (old_level);
+
+	/* Other threads filled the cache while we refilled it. */
+	while (i < cnt)
+		buddy_put (pool, pg_no (batch[i++]) - pg_no (pool->base), 1);
+}
+
+/* Gives up to PAGE_CNT of the oldest pages in POOL's page cache
+   back to its buddy allocator under one acquisition of its
+   lock. */
+static void
+pcp_drain (struct pool *pool, size_t page_cnt) {
+	void *batch[PCP_HIGH];
+	enum intr_level old_level;
+	size_t i;
+
+	old_level = intr_disable ();
+	if (page_cnt > pool->pcp_cnt)
+		page_cnt = pool->pcp_cnt;
+	memcpy (batch, pool->pcp, page_cnt * sizeof *batch);
+	memmove (pool->pcp, pool->pcp + page_cnt,
+			(pool->pcp_cnt - page_cnt) * sizeof *pool->pcp);
+	pool->pcp_cnt -= page_cnt;
+	pool->pcp_drains++;
+	intr_set_level (old_level);
+
+	lock_acquire (&pool->lock);
+	for (i = 0; i < page_cnt; i++) {
+		size_t page_idx = pg_no (batch[i]) - pg_no (pool->base);
+#ifndef NDEBUG
+		ASSERT (bitmap_test (pool->used_map, page_idx));
+		bitmap_reset (pool->used_map, page_idx);
+#endif
+		buddy_free (pool, page_idx, 1);
+	}
+	lock_release (&pool->lock);
+}
+
+/* Returns a free page from POOL's page cache, refilling the cache
+   first if it is empty, or a null pointer if POOL is out of
+   pages.  Counts the get as a cache hit or miss if COUNT is
+   true. */
+static void *
+pcp_get (struct pool *pool, bool count) {
+	enum intr_level old_level;
+	void *page = NULL;
+
+	old_level = intr_disable ();
+	if (pool->pcp_cnt > 0) {
+		if (count)
+			pool->pcp_hits++;
+	} else {
+		if (count)
+			pool->pcp_misses++;
+		intr_set_level (old_level);
+		pcp_refill (pool);
+		old_level = intr_disable ();
+	}
+	if (pool->pcp_cnt > 0)
+		page = pool->pcp[--pool->pcp_cnt];
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Puts free PAGE in POOL's page cache, draining a batch of the
+   oldest cached pages first if the cache is full. */
+static void
+pcp_put (struct pool *pool, void *page) {
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
+#ifndef NDEBUG
+	/* Catch double frees of pages still in the cache. */
+	for (size_t i = 0; i < pool->pcp_cnt; i++)
+		ASSERT (pool->pcp[i] != page);
+#endif
+	while (pool->pcp_cnt >= PCP_HIGH) {
+		intr_set_level (old_level);
+		pcp_drain (pool, PCP_BATCH);
+		old_level = intr_disable ();
+	}
+	pool->pcp[pool->pcp_cnt++] = page;
+	intr_set_level (old_level);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, through its page
+   cache for a single page, and returns them without clearing
+   them, or a null pointer if POOL has too few free pages. */
+static void *
+pool_get (struct pool *pool, size_t page_cnt) {
+	size_t page_idx;
+
+	if (page_cnt == 1)
+		return pcp_get (pool, true);
+
+	page_idx = buddy_get (pool, page_cnt);
+
+	/* Pages sitting in the page cache might be what keeps a large
+	   enough block from forming. */
+	if (page_idx == BITMAP_ERROR && pool->pcp_cnt > 0) {
+		pcp_drain (pool, PCP_HIGH);
+		page_idx = buddy_get (pool, page_cnt);
+	}
+	return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Obtains PAGE_CNT contiguous pages as palloc_get_multiple()
+   does, on behalf of CALLER. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, void *caller) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	void *pages = NULL;
+
+	if (palloc_prezero && page_cnt == 1 && (flags & PAL_ZERO))
+		pages = zeroed_get (pool);
+
+	if (pages == NULL) {
+		pages = pool_get (pool, page_cnt);
+		if (pages == NULL && zeroed_flush (pool))
+			pages = pool_get (pool, page_cnt);
+		if (pages != NULL && (flags & PAL_ZERO))
+			memset (pages, 0, PGSIZE * page_cnt);
+	}
+
+	account_get (pool, pages, page_cnt, caller);
+	if (pages == NULL && (flags & PAL_ASSERT))
+		PANIC ("palloc_get: out of pages");
+
+	return pages;
+}
+
+/* Counts an attempt by CALLER to get PAGE_CNT pages from POOL,
+   which returned PAGES, or a null pointer if it failed. */
+static void
+account_get (struct pool *pool, void *pages, size_t page_cnt,
+		void *caller UNUSED) {
+	enum intr_level old_level = intr_disable ();
+
+	if (pages != NULL) {
+		alloc_stats_alloc (&pool->stats, page_cnt);
+#ifdef MALLOC_DEBUG
+		size_t page_idx = pg_no (pages) - pg_no (pool->base);
+		size_t i;
+
+		for (i = 0; i < page_cnt; i++)
+			pool->owners[page_idx + i] = caller;
+#endif
+	} else
+		pool->stats.fails++;
+
+	intr_set_level (old_level);
+}
+
+/* Counts the freeing of the PAGE_CNT pages at PAGES in POOL, as a
+   shrink of the block before them if SHRINK is true. */
+static void
+account_put (struct pool *pool, void *pages UNUSED, size_t page_cnt,
+		bool shrink) {
+	enum intr_level old_level = intr_disable ();
+
+	if (shrink)
+		alloc_stats_resize (&pool->stats, -(long long) page_cnt);
+	else
+		alloc_stats_free (&pool->stats, page_cnt);
+#ifdef MALLOC_DEBUG
+	size_t page_idx = pg_no (pages) - pg_no (pool->base);
+	size_t i;
+
+	for (i = 0; i < page_cnt; i++)
+		pool->owners[page_idx + i] = NULL;
+#endif
+
+	intr_set_level (old_level);
+}
+
+/* Returns a pre-zeroed page from POOL, or a null pointer if there
+   is none, and lets the prezero thread know it has work. */
+static void *
+zeroed_get (struct pool *pool) {
+	enum intr_level old_level;
+	void *page = NULL;
+
+	old_level = intr_disable ();
+	if (pool->zeroed_cnt > 0) {
+		page = pool->zeroed[--pool->zeroed_cnt];
+		pool->zeroed_hits++;
+	} else
+		pool->zeroed_misses++;
+	if (prezero_waiting) {
+		prezero_waiting = false;
+		sema_up (&prezero_sema);
+	}
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Frees all of POOL's pre-zeroed pages so that other requests can
+   use them.  Returns true if there were any. */
+static bool
+zeroed_flush (struct pool *pool) {
+	void *batch[ZEROED_HIGH];
+	enum intr_level old_level;
+	size_t cnt, i;
+
+	old_level = intr_disable ();
+	cnt = pool->zeroed_cnt;
+	memcpy (batch, pool->zeroed, cnt * sizeof *batch);
+	pool->zeroed_cnt = 0;
+	intr_set_level (old_level);
+
+	for (i = 0; i < cnt; i++)
+		buddy_put (pool, pg_no (batch[i]) - pg_no (pool->base), 1);
+	return cnt > 0;
+}
+
+/* Zeroes one page for POOL, if it has room for another pre-zeroed
+   page and free pages to spare.  Returns true if it did.  The
+   page's get is not counted as a page cache hit or miss, since no
+   request made it. */
+static bool
+prezero_one (struct pool *pool) {
+	enum intr_level old_level;
+	long long free_cnt;
+	void *page;
+
+	old_level = intr_disable ();
+	free_cnt = (long long) pool->page_cnt - pool->stats.cur
+		- (long long) pool->zeroed_cnt;
+	intr_set_level (old_level);
+	if (pool->zeroed_cnt >= ZEROED_HIGH || free_cnt <= PREZERO_MIN_FREE)
+		return false;
+	page = pcp_get (pool, false);
+	if (page == NULL)
+		return false;
+	memset (page, 0, PGSIZE);
+
+	old_level = intr_disable ();
+	if (pool->zeroed_cnt < ZEROED_HIGH) {
+		pool->zeroed[pool->zeroed_cnt++] = page;
+		page = NULL;
+	}
+	intr_set_level (old_level);
+
+	if (page != NULL)
+		pcp_put (pool, page);
+	return true;
+}
+
+/* Prezero thread.  Runs at the lowest priority, so that zeroing
+   uses time that would otherwise be idle, and keeps both pools'
+   pre-zeroed pages topped up.  Once neither pool needs or can
+   spare a page, waits for a PAL_ZERO request to take one. */
+static void
+prezero (void *aux UNUSED) {
+	if (thread_mlfqs)
+		thread_set_nice (NICE_MAX);
+
+	for (;;) {
+		bool zeroed = prezero_one (&kernel_pool);
+		zeroed = prezero_one (&user_pool) || zeroed;
+
+		if (!zeroed) {
+			enum intr_level old_level = intr_disable ();
+			prezero_waiting = true;
+			intr_set_level (old_level);
+			sema_down (&prezero_sema);
+		}
+	}
+}
+
+/* Starts the prezero thread.  Called once, after the scheduler is
+   started, if the -prezero option was given. */
+void
+palloc_start_prezero (void) {
+	sema_init (&prezero_sema, 0);
+	thread_create ("prezero", PRI_MIN, prezero, NULL);
+}
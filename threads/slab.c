@@ -0,0 +1,266 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator for frequently allocated kernel objects.
+
+   malloc() rounds each request up to a power of 2, which wastes
+   up to half of every block, and all requests of a size class
+   share one lock.  A "cache" instead hands out objects of one
+   exact size, rounded up only to the requested alignment, and
+   has a lock of its own.
+
+   A cache takes memory from the page allocator one page, called
+   a "slab", at a time.  The start of each slab holds a header
+   and a stack of the indexes of its free objects; the objects
+   fill the rest of the page.  Slabs with some but not all of
+   their objects free are on the cache's partial list, which is
+   where allocations are satisfied from.  Slabs with none free
+   are on the full list.  When a slab's last object is freed, it
+   is kept on the empty list, unless there is already an empty
+   slab, in which case its page goes back to the page allocator.
+
+   If the cache has a constructor, it is called on every object
+   once, when the object's slab is created, rather than on every
+   allocation.  Objects must be returned to the cache in their
+   constructed state, so that whatever the constructor sets up
+   (locks, lists, and so on) can be reused as-is.  For the same
+   reason the free list is kept in the slab header instead of in
+   the free objects themselves. */
+
+/* Cache. */
+struct kmem_cache {
+	const char *name;           /* For debugging. */
+	size_t obj_size;            /* Object size, a multiple of ALIGN. */
+	size_t align;               /* Object alignment. */
+	kmem_ctor_func *ctor;       /* Constructor, or a null pointer. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	size_t obj_ofs;             /* Offset of first object in a slab. */
+	struct list partial;        /* Slabs with some objects free. */
+	struct list full;           /* Slabs with no objects free. */
+	struct list empty;          /* Slabs with all objects free. */
+	struct lock lock;           /* Protects the lists and slabs. */
+};
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Empty slabs kept per cache before pages are freed. */
+#define SLAB_EMPTY_MAX 1
+
+/* Slab header, at the start of the slab's page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of the cache's lists. */
+	size_t free_cnt;            /* Number of free objects. */
+	uint16_t free[];            /* Free object indexes, a stack. */
+};
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void *slab_to_obj (struct kmem_cache *, struct slab *, size_t idx);
+
+/* Returns the offset of the first object in a slab of CNT
+   objects aligned to ALIGN bytes. */
+static size_t
+slab_obj_ofs (size_t cnt, size_t align) {
+	return ROUND_UP (sizeof (struct slab) + cnt * sizeof (uint16_t), align);
+}
+
+/* Creates and returns a new cache of SIZE-byte objects aligned
+   to ALIGN bytes, which must be a power of 2 (or 0, for pointer
+   alignment).  If CTOR is nonnull, it is called on each object
+   when the object's slab is created.  NAME identifies the cache
+   when debugging and must stay valid for the cache's lifetime.
+   Returns a null pointer if memory is not available or if SIZE
+   is too big for an object to fit in a one-page slab. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+		kmem_ctor_func *ctor) {
+	struct kmem_cache *c;
+	size_t cnt;
+
+	ASSERT (name != NULL);
+	ASSERT (size > 0);
+	if (align < sizeof (void *))
+		align = sizeof (void *);
+	ASSERT ((align & (align - 1)) == 0);
+	size = ROUND_UP (size, align);
+
+	/* Fit as many objects as possible, together with their
+	   header, into a page. */
+	if (slab_obj_ofs (1, align) + size > PGSIZE)
+		return NULL;
+	cnt = (PGSIZE - sizeof (struct slab)) / (size + sizeof (uint16_t));
+	while (slab_obj_ofs (cnt, align) + cnt * size > PGSIZE)
+		cnt--;
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		return NULL;
+	c->name = name;
+	c->obj_size = size;
+	c->align = align;
+	c->ctor = ctor;
+	c->objs_per_slab = cnt;
+	c->obj_ofs = slab_obj_ofs (cnt, align);
+	list_init (&c->partial);
+	list_init (&c->full);
+	list_init (&c->empty);
+	lock_init (&c->lock);
+	return c;
+}
+
+/* Destroys cache C, which must have no objects allocated, and
+   returns its memory to the page allocator. */
+void
+kmem_cache_destroy (struct kmem_cache *c) {
+	if (c == NULL)
+		return;
+
+	ASSERT (list_empty (&c->partial));
+	ASSERT (list_empty (&c->full));
+	while (!list_empty (&c->empty))
+		palloc_free_page (list_entry (list_pop_front (&c->empty),
+					struct slab, elem));
+	free (c);
+}
+
+/* Obtains and returns an object from cache C.  If C has a
+   constructor, the object is in its constructed state; otherwise
+   its contents are undefined.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+	void *obj;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+
+	/* Find a slab with a free object, creating one if needed. */
+	if (!list_empty (&c->partial))
+		s = list_entry (list_front (&c->partial), struct slab, elem);
+	else {
+		if (!list_empty (&c->empty))
+			s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+		else {
+			s = slab_create (c);
+			if (s == NULL) {
+				lock_release (&c->lock);
+				return NULL;
+			}
+		}
+		list_push_front (&c->partial, &s->elem);
+	}
+
+	/* Take an object, and retire the slab if it is now full. */
+	obj = slab_to_obj (c, s, s->free[--s->free_cnt]);
+	if (s->free_cnt == 0) {
+		list_remove (&s->elem);
+		list_push_front (&c->full, &s->elem);
+	}
+
+	lock_release (&c->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C with
+   kmem_cache_alloc(), to C.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+	size_t idx;
+
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (c, obj);
+	idx = ((uint8_t *) obj - (uint8_t *) s - c->obj_ofs) / c->obj_size;
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs.  An
+	   object with a constructor has to stay constructed. */
+	if (c->ctor == NULL)
+		memset (obj, 0xcc, c->obj_size);
+#endif
+
+	lock_acquire (&c->lock);
+
+	ASSERT (s->free_cnt < c->objs_per_slab);
+	s->free[s->free_cnt++] = idx;
+	if (s->free_cnt == 1) {
+		/* Was full, now partial. */
+		list_remove (&s->elem);
+		list_push_front (&c->partial, &s->elem);
+	}
+	if (s->free_cnt == c->objs_per_slab) {
+		/* Now empty.  Keep it around, if we have room. */
+		list_remove (&s->elem);
+		if (list_size (&c->empty) < SLAB_EMPTY_MAX)
+			list_push_front (&c->empty, &s->elem);
+		else {
+			s->magic = 0;
+			palloc_free_page (s);
+		}
+	}
+
+	lock_release (&c->lock);
+}
+
+/* Allocates a new slab for cache C, with all of its objects
+   free and constructed.  Must hold C's lock.
+   Returns a null pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c) {
+	struct slab *s;
+	size_t i;
+
+	s = palloc_get_page (0);
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = c;
+	s->free_cnt = c->objs_per_slab;
+	for (i = 0; i < c->objs_per_slab; i++) {
+		/* Hand out the lowest addresses first. */
+		s->free[i] = c->objs_per_slab - i - 1;
+		if (c->ctor != NULL)
+			c->ctor (slab_to_obj (c, s, i));
+	}
+	return s;
+}
+
+/* Returns the slab that OBJ, an object from cache C, is in. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid and belongs to C. */
+	ASSERT (s != NULL);
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == c);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT (pg_ofs (obj) >= c->obj_ofs);
+	ASSERT ((pg_ofs (obj) - c->obj_ofs) % c->obj_size == 0);
+
+	return s;
+}
+
+/* Returns the IDX'th object within slab S of cache C. */
+static void *
+slab_to_obj (struct kmem_cache *c, struct slab *s, size_t idx) {
+	ASSERT (idx < c->objs_per_slab);
+	return (uint8_t *) s + c->obj_ofs + idx * c->obj_size;
+}
@@ -32,7 +32,11 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
-
+static pq_less_func waiter_less;
+static pq_less_func sema_elem_less;
+static pq_less_func held_less;
+static void sema_wait (struct semaphore *);
+static bool sema_wake (struct semaphore *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,7 +52,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	pq_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -67,10 +71,8 @@ sema_down (struct semaphore *sema) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	while (sema->value == 0) {
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, cmp_priority_ready, NULL);
-		thread_block ();
-	}
+	while (sema->value == 0)
+		sema_wait (sema);
 	sema->value--;
 	intr_set_level (old_level);
 }
@@ -110,36 +112,72 @@ sema_up (struct semaphore *sema) {
 
 	ASSERT (sema != NULL);
 
-	struct thread *next_thread;
 	old_level = intr_disable();
-	if (!list_empty(&sema->waiters))
-	{
-      list_sort(&sema->waiters, cmp_priority_ready, NULL);
-		next_thread = list_entry(list_pop_front(&sema->waiters), struct thread, elem);
-		
-      thread_unblock(next_thread);
-	
-   }
+	sema_wake (sema);
 	sema->value++;
 
    test_max_priority();
 	intr_set_level (old_level);
 }
 
-bool cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
+/* Blocks the running thread among SEMA's waiters until
+   sema_wake() picks it.  Interrupts must be off. */
+static void
+sema_wait (struct semaphore *sema) {
+	struct thread *cur = thread_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	cur->waiting_on = sema;
+	pq_push (&sema->waiters, &cur->wait_elem);
+	thread_block ();
+}
+
+/* Unblocks the highest-priority thread waiting on SEMA, if any,
+   without touching SEMA's value.  Returns true if a thread was
+   unblocked.  Interrupts must be off. */
+static bool
+sema_wake (struct semaphore *sema) {
+	struct thread *t;
+
+	ASSERT (intr_get_level () == INTR_OFF);
 
-    struct semaphore_elem *sa = list_entry(a, struct semaphore_elem, elem);
-    struct semaphore_elem *sb = list_entry(b, struct semaphore_elem, elem);
-    if (list_empty(&sa->semaphore.waiters)) {
+	if (pq_empty (&sema->waiters))
 		return false;
-    }
-    if (list_empty(&sb->semaphore.waiters)) {
-        return true;
-    }
-    struct thread *thread_a = list_entry(list_front(&sa->semaphore.waiters), struct thread, elem);
-    struct thread *thread_b = list_entry(list_front(&sb->semaphore.waiters), struct thread, elem);
+	t = pq_entry (pq_pop (&sema->waiters), struct thread, wait_elem);
+	t->waiting_on = NULL;
+	thread_unblock (t);
+	return true;
+}
 
-    return thread_a->priority > thread_b->priority;
+/* Orders semaphore waiters A and B by priority. */
+static bool
+waiter_less (const struct pq_elem *a, const struct pq_elem *b,
+		void *aux UNUSED) {
+	return pq_entry (a, struct thread, wait_elem)->priority
+		< pq_entry (b, struct thread, wait_elem)->priority;
+}
+
+/* Orders condition variable waiters A and B by the priority of
+   the threads waiting on them. */
+static bool
+sema_elem_less (const struct pq_elem *a, const struct pq_elem *b,
+		void *aux UNUSED) {
+	return pq_entry (a, struct semaphore_elem, elem)->thread->priority
+		< pq_entry (b, struct semaphore_elem, elem)->thread->priority;
+}
+
+/* Called by thread_change_priority() after T's priority changes,
+   with interrupts off, to move T to its new place among the
+   waiters of the semaphore or condition variable it waits on. */
+void
+synch_priority_changed (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (t->waiting_on != NULL)
+		pq_update (&t->waiting_on->waiters, &t->wait_elem);
+	if (t->cond_waiter != NULL)
+		pq_update (&t->cond_waiter->cond->waiters, &t->cond_waiter->elem);
 }
 
 static void sema_test_helper (void *sema_);
@@ -196,8 +234,97 @@ void
 lock_init (struct lock *lock) {
 	ASSERT (lock != NULL);
 
-	lock->holder = NULL;
-	sema_init (&lock->semaphore, 1);
+	lock->state = LOCK_FREE;
+	sema_init (&lock->semaphore, 0);
+	lock->max_priority = PRI_MIN - 1;
+	lock->donating = false;
+}
+
+/* Priority donation.
+
+   Each lock records the highest priority of the threads waiting
+   for it in max_priority, and each thread keeps the locks it
+   holds that have waiters in held_locks, a priority queue on
+   max_priority that links the locks themselves, so there is no
+   limit on how many a thread may hold.  A thread's effective
+   priority is the larger of its base priority and the front of
+   that queue, so releasing a lock costs one removal instead of a
+   scan and sort of every donor.
+
+   A waiter's priority can only go up while it waits, since it
+   is blocked and cannot release locks or lower its own priority.
+   So donation only ever raises max_priority, and propagation
+   along a chain of lock holders stops at the first lock or holder
+   that is already at least as high.
+
+   All of this runs with interrupts off. */
+
+/* Returns the highest priority of the threads waiting on SEMA, or
+   PRI_MIN - 1 if there are none. */
+static int
+sema_max_priority (struct semaphore *sema) {
+	if (pq_empty (&sema->waiters))
+		return PRI_MIN - 1;
+	return pq_entry (pq_front (&sema->waiters), struct thread,
+			wait_elem)->priority;
+}
+
+/* Orders locks A and B by the highest priority waiting on them. */
+static bool
+held_less (const struct pq_elem *a, const struct pq_elem *b,
+		void *aux UNUSED) {
+	return pq_entry (a, struct lock, held_elem)->max_priority
+		< pq_entry (b, struct lock, held_elem)->max_priority;
+}
+
+/* Initializes the synchronization state of new thread T. */
+void
+synch_thread_init (struct thread *t) {
+	pq_init (&t->held_locks, held_less, NULL);
+}
+
+/* Adds LOCK, which T holds, to T's held_locks. */
+static void
+held_push (struct thread *t, struct lock *lock) {
+	ASSERT (!lock->donating);
+
+	pq_push (&t->held_locks, &lock->held_elem);
+	lock->donating = true;
+}
+
+/* Removes LOCK from its holder T's held_locks. */
+static void
+held_remove (struct thread *t, struct lock *lock) {
+	ASSERT (lock->donating);
+
+	pq_remove (&t->held_locks, &lock->held_elem);
+	lock->donating = false;
+}
+
+/* Donates the running thread's priority to the holder of LOCK,
+   which it is about to wait for, and on along the chain of
+   holders waiting for other locks. */
+static void
+donate_priority (struct lock *lock) {
+	int priority = thread_current ()->priority;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (lock != NULL && lock_holder (lock) != NULL
+			&& lock->max_priority < priority) {
+		struct thread *holder = lock_holder (lock);
+
+		lock->max_priority = priority;
+		if (!lock->donating)
+			held_push (holder, lock);
+		else
+			pq_update (&holder->held_locks, &lock->held_elem);
+
+		if (holder->priority >= priority)
+			break;
+		thread_change_priority (holder, priority);
+		lock = holder->wait_on_lock;
+	}
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -207,7 +334,14 @@ lock_init (struct lock *lock) {
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
-   we need to sleep. */
+   we need to sleep.
+
+   An uncontended acquire is a single compare-and-swap of the
+   lock's state from LOCK_FREE to the running thread's address, so
+   the holder is known, and can be donated to, for as long as the
+   lock is held.  Otherwise we mark the lock LOCK_CONTENDED, so
+   that the holder's release takes the slow path and wakes us, and
+   wait with interrupts off. */
 
 void lock_acquire(struct lock *lock) {
     ASSERT(lock != NULL);
@@ -216,16 +350,34 @@ void lock_acquire(struct lock *lock) {
 
     struct thread *cur = thread_current();  // 현재 스레드를 가져옴
 
-    if (lock->holder != NULL) {
-      struct thread *cur = thread_current();
-      cur->wait_on_lock = lock;  // 현재 스레드가 기다리고 있는 락을 설정
-      list_insert_ordered(&lock->holder->donations, &cur->donation_elem, thread_compare_donate_priority, 0); // 우선순위 기부
-      donate_priority();  // 우선순위 기부 로직 실행
+    // 경쟁이 없으면 인터럽트를 끄지 않고 바로 획득
+    if (lock_try_acquire(lock))
+      return;
+
+    enum intr_level old_level = intr_disable();
+    while (lock->state != LOCK_FREE) {
+      lock->state |= LOCK_CONTENDED;
+      if (!thread_mlfqs) {
+        cur->wait_on_lock = lock;  // 현재 스레드가 기다리고 있는 락을 설정
+        donate_priority(lock);  // 우선순위 기부
+      }
+      sema_wait(&lock->semaphore);
     }
-
-    sema_down(&lock->semaphore);  // 세마포어 다운 (락을 획득)
     cur->wait_on_lock = NULL;  // 락을 얻었으므로 대기 중인 락을 해제
-    lock->holder = cur;  // 현재 스레드를 락의 소유자로 설정
+
+    // 현재 스레드를 락의 소유자로 설정하고, 남은 대기자들의 우선순위를
+    // 새 소유자에게 기부
+    if (pq_empty(&lock->semaphore.waiters))
+      lock->state = (uintptr_t) cur;
+    else {
+      lock->state = (uintptr_t) cur | LOCK_CONTENDED;
+      if (!thread_mlfqs) {
+        lock->max_priority = sema_max_priority(&lock->semaphore);
+        held_push(cur, lock);
+        refresh_priority();
+      }
+    }
+    intr_set_level(old_level);
 }
 
 
@@ -242,9 +394,10 @@ lock_try_acquire (struct lock *lock) {
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	success = sema_try_down (&lock->semaphore);
-	if (success)
-		lock->holder = thread_current ();
+	uintptr_t state = LOCK_FREE;
+	success = __atomic_compare_exchange_n (&lock->state, &state,
+			(uintptr_t) thread_current (), false, __ATOMIC_ACQUIRE,
+			__ATOMIC_RELAXED);
 	return success;
 }
 
@@ -253,18 +406,35 @@ lock_try_acquire (struct lock *lock) {
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
-   handler. */
+   handler.
+
+   If nobody waited for LOCK while we held it, its state is still
+   just our address and releasing it is a single compare-and-swap
+   back to LOCK_FREE.  A contended lock cannot have been donated through
+   otherwise, so there is no priority to recompute. */
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
-  
-  remove_with_lock(lock);
-  refresh_priority();  
-  
-  lock->holder = NULL;
-  sema_up (&lock->semaphore);
+
+  uintptr_t state = (uintptr_t) cur;
+  if (__atomic_compare_exchange_n (&lock->state, &state, LOCK_FREE,
+        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    return;
+
+  enum intr_level old_level = intr_disable ();
+  if (lock->donating)
+    held_remove (cur, lock);
+  lock->max_priority = PRI_MIN - 1;
+  refresh_priority ();
+
+  lock->state = LOCK_FREE;
+  sema_wake (&lock->semaphore);
+  test_max_priority ();
+  intr_set_level (old_level);
 }
 
 
@@ -275,7 +445,104 @@ bool
 lock_held_by_current_thread (const struct lock *lock) {
 	ASSERT (lock != NULL);
 
-	return lock->holder == thread_current ();
+	return lock_holder (lock) == thread_current ();
+}
+
+/* Returns the thread that holds LOCK, or a null pointer if LOCK is
+   free. */
+struct thread *
+lock_holder (const struct lock *lock) {
+	ASSERT (lock != NULL);
+
+	return (struct thread *) (lock->state & ~(uintptr_t) LOCK_CONTENDED);
+}
+
+/* Initializes RW.  A readers-writer lock may be held by any
+   number of readers at once, or by a single writer.
+
+   A writer holds RW's inner lock for as long as it writes, and
+   readers take that lock only long enough to count themselves
+   in.  So a writer that has the inner lock and is waiting for
+   the last readers to leave keeps new readers out, which gives
+   writers preference, and every thread waiting to read or write
+   donates its priority to the writer through the inner lock.
+   Readers holding RW receive no donation.
+
+   A thread that holds RW for reading must not acquire it again,
+   for reading or writing, since a writer may be waiting. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	sema_init (&rw->drained, 0);
+	rw->readers = 0;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	rw->readers++;
+	intr_set_level (old_level);
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   last reader out wakes a writer waiting for the readers to
+   drain. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (rw->readers > 0);
+
+	old_level = intr_disable ();
+	if (--rw->readers == 0 && sema_wake (&rw->drained))
+		test_max_priority ();
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other writer holds
+   it and every reader has released it. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	while (rw->readers > 0)
+		sema_wait (&rw->drained);
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rwlock_held_for_write (rw));
+
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return lock_held_by_current_thread (&rw->lock) && rw->readers == 0;
 }
 
 
@@ -287,7 +554,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	pq_init (&cond->waiters, sema_elem_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -320,8 +587,14 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
+	waiter.thread = thread_current ();
+	waiter.cond = cond;
+
+	enum intr_level old_level = intr_disable ();
+	waiter.thread->cond_waiter = &waiter;
+	pq_push (&cond->waiters, &waiter.elem);
+	intr_set_level (old_level);
 
-   list_insert_ordered(&cond->waiters, &waiter.elem, cmp_sem_priority, NULL);
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
 	lock_acquire (lock);
@@ -341,11 +614,14 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED) {
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters)){
-		list_sort(&cond->waiters, cmp_sem_priority, NULL);
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
+	enum intr_level old_level = intr_disable ();
+	if (!pq_empty (&cond->waiters)) {
+		struct semaphore_elem *waiter =
+			pq_entry (pq_pop (&cond->waiters), struct semaphore_elem, elem);
+		waiter->thread->cond_waiter = NULL;
+		sema_up (&waiter->semaphore);
 	}
+	intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -359,6 +635,6 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!pq_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
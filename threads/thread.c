@@ -7,9 +7,12 @@
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -24,17 +27,58 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* list of processes in THREAD_BLOCKED state, that is, processes
-	 that are waiting for awake */
-static struct list wait_list;
-
-/* Thread destruction requests */
+/* Run queue of processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   FIFO list per priority level; bit P of ready_bitmap is set iff
+   ready_queues[P] is nonempty, so the highest runnable priority
+   is found with a single bit scan. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static size_t ready_cnt;        /* # of threads in the run queue. */
+
+/* List of all live threads, linked through allelem.  Used by the
+   MLFQS scheduler's once-per-second recalculation. */
+static struct list all_list;
+
+/* Sleep queue: processes in THREAD_BLOCKED state that are waiting
+   for their awake_ticks to pass, kept as a binary min-heap ordered
+   by awake_ticks.  Insertion and removal of the earliest sleeper
+   are O(log n), and the earliest deadline is always sleep_heap[0].
+
+   The heap starts out in a small static array, so sleeping works
+   before malloc() is up, and is grown by doubling from thread
+   context (never from the timer interrupt) as sleepers pile up. */
+#define SLEEP_HEAP_INIT_CAP 32
+static struct thread *sleep_heap_init[SLEEP_HEAP_INIT_CAP];
+static struct thread **sleep_heap = sleep_heap_init;
+static size_t sleep_cnt;
+static size_t sleep_cap = SLEEP_HEAP_INIT_CAP;
+
+/* Thread destruction requests: threads that have exited and are
+   off the CPU, waiting to be recycled by the reaper. */
 static struct list destruction_req;
 
+/* Cache of recycled thread pages.  Each entry is a dead thread's
+   page, linked through its `elem', that still owns its fd_table
+   with every entry already cleared.  thread_create() takes from
+   here before going to the page allocator, which saves four page
+   allocations and 16 kB of zeroing per thread.  Protected by
+   disabling interrupts. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+
+/* Reaper thread, which moves threads from destruction_req into
+   the thread cache at low priority, and whether it is waiting
+   for work. */
+static struct thread *reaper_thread;
+static bool reaper_waiting;
+
+/* Thread cache statistics. */
+static long long thread_cache_hits;     /* Pages reused. */
+static long long thread_cache_misses;   /* Pages from palloc. */
+static long long threads_reaped;        /* Threads recycled by reaper. */
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -59,14 +103,72 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true (default), switch between kernel threads by saving only
+   the callee-saved registers (see switch.S).  If false, every
+   switch saves a full intr_frame and goes through iretq.
+   Cleared by kernel command-line option "-no-fast-switch". */
+bool thread_fast_switch = true;
+
+/* MLFQS state.  load_avg is the system load average, an estimate
+   of the number of threads ready to run over the past minute. */
+static fixed_t load_avg;
+
+/* Global ready-queue latency histogram; see ready_hist_bucket(). */
+static long long ready_hist[READY_HIST_BUCKETS];
+
+/* Scheduler trace: a ring buffer holding the last SCHED_TRACE_SIZE
+   context switches, written by schedule() with interrupts off.
+   There is only one writer and it cannot be interrupted, so no
+   lock is needed; sched_trace_cnt counts every switch ever
+   recorded and the newest event is at index
+   (sched_trace_cnt - 1) % SCHED_TRACE_SIZE. */
+enum sched_reason {
+	SCHED_BLOCK,            /* Running thread blocked. */
+	SCHED_YIELD,            /* Running thread yielded. */
+	SCHED_PREEMPT,          /* Running thread was preempted. */
+	SCHED_EXIT              /* Running thread exited. */
+};
+
+struct sched_event {
+	int64_t tick;           /* timer_ticks() at the switch. */
+	tid_t prev;             /* Thread switched away from. */
+	tid_t next;             /* Thread switched to. */
+	enum sched_reason reason;
+};
+
+#define SCHED_TRACE_SIZE 256    /* Must be a power of 2. */
+static struct sched_event sched_trace[SCHED_TRACE_SIZE];
+static unsigned long long sched_trace_cnt;
+
+/* MLFQS statistics: TSC cycles spent in the per-tick and
+   per-second parts of the scheduler's timer work. */
+static long long mlfqs_tick_cnt, mlfqs_tick_cycles;
+static long long mlfqs_second_cnt, mlfqs_second_cycles;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void reaper (void *aux UNUSED);
+static struct thread *thread_alloc (void);
+static void thread_recycle (struct thread *);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
-static void do_schedule(int status);
-static void schedule (void);
+static void do_schedule(int status, bool preempted);
+static void schedule (bool preempted);
 static tid_t allocate_tid (void);
+static void sleep_heap_reserve (void);
+static void sleep_heap_push (struct thread *);
+static struct thread *sleep_heap_pop (void);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static void mlfqs_tick (int64_t ticks);
+static void mlfqs_second (void);
+static void mlfqs_update_priority (struct thread *);
+static void yield_current (bool preempted);
+static int ready_hist_bucket (uint64_t cycles);
+static void sched_trace_record (struct thread *prev, struct thread *next,
+		bool preempted);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -112,9 +214,12 @@ thread_init (void) {
 
 	/* Init the global thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
+	for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+		list_init (&ready_queues[pri]);
+	ready_bitmap = 0;
+	list_init (&all_list);
 	list_init (&destruction_req);
-	list_init (&wait_list);
+	list_init (&thread_cache);
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
@@ -136,6 +241,9 @@ thread_start (void) {
 
 	/* Wait for the idle thread to initialize idle_thread. */
 	sema_down (&idle_started);
+
+	/* Create the reaper thread. */
+	thread_create ("reaper", PRI_MIN, reaper, NULL);
 }
 
 /* Called by the timer interrupt handler at each timer tick.
@@ -145,6 +253,7 @@ thread_tick (void) {
 	struct thread *t = thread_current ();
 
 	/* Update statistics. */
+	t->run_ticks++;
 	if (t == idle_thread)
 		idle_ticks++;
 #ifdef USERPROG
@@ -154,16 +263,122 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
+	if (thread_mlfqs)
+		mlfqs_tick (timer_ticks ());
+
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
+/* Credits N timer ticks, during which the periodic tick was
+   stopped, to the idle thread.  Called by the timer with
+   interrupts off. */
+void
+thread_tick_idle (int64_t n) {
+	int64_t now;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	idle_ticks += n;
+
+	/* The idle thread accrues no recent_cpu, but a second
+	   boundary may have passed while the tick was stopped. */
+	now = timer_ticks ();
+	if (thread_mlfqs && now / TIMER_FREQ != (now - n) / TIMER_FREQ)
+		mlfqs_second ();
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	printf ("Thread: %lld cache hits, %lld cache misses, %lld reaped\n",
+			thread_cache_hits, thread_cache_misses, threads_reaped);
+	if (thread_mlfqs)
+		printf ("MLFQS: %lld tick updates (%lld cycles avg), "
+				"%lld second updates (%lld cycles avg)\n",
+				mlfqs_tick_cnt,
+				mlfqs_tick_cnt ? mlfqs_tick_cycles / mlfqs_tick_cnt : 0,
+				mlfqs_second_cnt,
+				mlfqs_second_cnt ? mlfqs_second_cycles / mlfqs_second_cnt : 0);
+}
+
+/* MLFQS work done on every timer tick.  Only the running thread's
+   recent_cpu changes from tick to tick, so only its priority can
+   change between the once-per-second recalculations; it is
+   recomputed every fourth tick, as 4.4BSD does, without touching
+   any other thread. */
+static void
+mlfqs_tick (int64_t ticks) {
+	struct thread *t = thread_current ();
+	uint64_t start = rdtsc ();
+
+	if (t != idle_thread)
+		t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+	if (ticks % TIMER_FREQ == 0)
+		mlfqs_second ();
+	else if (ticks % TIME_SLICE == 0 && t != idle_thread) {
+		mlfqs_update_priority (t);
+		if (check_priority_threads ())
+			intr_yield_on_return ();
+	}
+
+	mlfqs_tick_cnt++;
+	mlfqs_tick_cycles += rdtsc () - start;
+}
+
+/* MLFQS work done once per second: updates the load average,
+   then decays every thread's recent_cpu and recomputes its
+   priority. */
+static void
+mlfqs_second (void) {
+	struct thread *curr = thread_current ();
+	uint64_t start = rdtsc ();
+	struct list_elem *e;
+	fixed_t coef;
+	int ready;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	/* load_avg = (59/60) * load_avg + (1/60) * ready_threads. */
+	ready = ready_cnt + (curr != idle_thread ? 1 : 0);
+	load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+			fp_div_int (fp_from_int (ready), 60));
+
+	/* recent_cpu = (2*load_avg) / (2*load_avg + 1) * recent_cpu + nice. */
+	coef = fp_div (fp_mul_int (load_avg, 2),
+			fp_add_int (fp_mul_int (load_avg, 2), 1));
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, allelem);
+		if (t == idle_thread)
+			continue;
+		t->recent_cpu = fp_add_int (fp_mul (coef, t->recent_cpu), t->nice);
+		mlfqs_update_priority (t);
+	}
+
+	if (check_priority_threads ())
+		intr_yield_on_return ();
+
+	mlfqs_second_cnt++;
+	mlfqs_second_cycles += rdtsc () - start;
+}
+
+/* Recomputes T's MLFQS priority,
+   PRI_MAX - (recent_cpu / 4) - (nice * 2), clamped to the valid
+   range, and moves T to its new run queue if it is ready. */
+static void
+mlfqs_update_priority (struct thread *t) {
+	int priority = PRI_MAX - fp_round (fp_div_int (t->recent_cpu, 4))
+		- t->nice * 2;
+
+	if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	else if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	thread_change_priority (t, priority);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -189,22 +404,23 @@ thread_create (const char *name, int priority,
 
 	ASSERT (function != NULL);
 
-	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	/* Allocate thread, along with a cleared fd_table. */
+	t = thread_alloc ();
 	if (t == NULL)
 		return TID_ERROR;
 
 	/* Initialize thread. */
+	struct file **fd_table = t->fd_table;
 	init_thread (t, name, priority);
 	tid = t->tid = allocate_tid ();
+	t->fd_table = fd_table;
 
 	struct thread *parent;
 	parent = thread_current();
+	enum intr_level old_level = intr_disable ();
+	t->parent = parent;
 	list_push_back(&parent->child_list, &t->child_elem);
-
-	t->fd_table = palloc_get_multiple(PAL_ZERO, FDT_PAGES);
-	if(t->fd_table == NULL)
-		return TID_ERROR;
+	intr_set_level (old_level);
 
 	t->fd_table[0] = 1;
 	t->fd_table[1] = 2;
@@ -227,23 +443,15 @@ thread_create (const char *name, int priority,
 	/* Add to run queue. */
 	thread_unblock (t);
 
-	if (priority > thread_get_priority()){
+	if (t->priority > thread_get_priority()){
 		thread_yield();
 	}
 	return tid;
 }
 
 void test_max_priority(void) {
-    if (list_empty(&ready_list)) {
-        return;
-    }
-    
-    struct thread *t;
-    struct list_elem* max = list_begin(&ready_list);
-    t = list_entry(max, struct thread, elem);
-
     // 현재 스레드의 우선순위와 비교
-    if (t->priority > thread_get_priority()) {
+    if (ready_queue_max_priority() > thread_get_priority()) {
         // 인터럽트 컨텍스트인지 확인
         if (intr_context()) {
             // 인터럽트 중이라면, 인터럽트 후 양보가 이루어지도록 설정
@@ -255,52 +463,146 @@ void test_max_priority(void) {
     }
 }
 
-/* list_insert_ordered에서 쓸 함수 정의 */
-bool cmp_priority_wait(const struct list_elem* A, const struct list_elem *B, void *aux) {
-    struct thread *thread_a = list_entry(A, struct thread, elem);
-    struct thread *thread_b = list_entry(B, struct thread, elem);
-    return thread_a->awake_ticks < thread_b->awake_ticks;
+/* Wakes every sleeping thread whose awake_ticks is at or before
+   TICKS, moving it from the sleep queue to the run queue.  Called
+   from the timer interrupt handler, so only the heap's front is
+   examined and no memory is allocated here. */
+void
+thread_awake (int64_t ticks) {
+	bool woke = false;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (sleep_cnt > 0 && sleep_heap[0]->awake_ticks <= ticks) {
+		thread_unblock (sleep_heap_pop ());
+		woke = true;
+	}
+
+	if (woke)
+		test_max_priority ();
 }
 
-bool cmp_priority_ready(const struct list_elem* A, const struct list_elem *B, void *aux) {
-    struct thread *thread_a = list_entry(A, struct thread, elem);
-    struct thread *thread_b = list_entry(B, struct thread, elem);
-    return thread_a->priority > thread_b->priority;
+/* Returns the earliest awake_ticks of any sleeping thread, or
+   INT64_MAX if no thread is sleeping. */
+int64_t
+thread_next_awake (void) {
+	return sleep_cnt > 0 ? sleep_heap[0]->awake_ticks : INT64_MAX;
 }
 
-/* wait_list에서 ready_list로 옮기기 */
-void thread_awake(int64_t ticks) {
-	while (!list_empty(&wait_list) && list_entry(list_front(&wait_list), struct thread, elem)->awake_ticks <= ticks) {
-		struct thread* awake_thread = list_entry(list_pop_front(&wait_list), struct thread, elem);
-		// curr -> status를 ready로 바꿔준다. block, unblock 함수 그대로 이용
-		// ready에 넣어줄 때도 list order로 넣어줘야 한다.
-		
-		thread_unblock(awake_thread);
+
+/* Puts the running thread to sleep until the timer reaches
+   AWAKE_TICKS.  Must be called with interrupts on, from thread
+   context. */
+void
+thread_sleep (int64_t awake_ticks) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (!intr_context ());
+	ASSERT (curr != idle_thread);
+
+	/* Make room in the heap first: growing it may sleep on
+	   malloc()'s locks, which must not happen with interrupts off.
+	   Another thread may take the slot before we disable
+	   interrupts, so retry until it is still free afterward. */
+	for (;;) {
+		sleep_heap_reserve ();
+		old_level = intr_disable ();
+		if (sleep_cnt < sleep_cap)
+			break;
+		intr_set_level (old_level);
 	}
+
+	curr->awake_ticks = awake_ticks;
+	sleep_heap_push (curr);
+	thread_block ();
+	intr_set_level (old_level);
 }
 
-void donate_priority() {
-    struct thread *curr = thread_current();
-    struct thread *holder;
+/* Returns true if sleeping thread A must wake before B.  Ties are
+   broken by tid to keep the wake-up order deterministic. */
+static inline bool
+sleep_before (const struct thread *a, const struct thread *b) {
+	if (a->awake_ticks != b->awake_ticks)
+		return a->awake_ticks < b->awake_ticks;
+	return a->tid < b->tid;
+}
 
-    while (curr->wait_on_lock != NULL) {
-        holder = curr->wait_on_lock->holder;
+/* Makes sure the sleep heap has room for one more thread,
+   doubling its capacity if not.  Interrupts must be on. */
+static void
+sleep_heap_reserve (void) {
+	struct thread **new_heap, **old_heap;
+	enum intr_level old_level;
+	size_t new_cap;
+
+	ASSERT (intr_get_level () == INTR_ON);
+
+	while (sleep_cnt >= sleep_cap) {
+		new_cap = sleep_cap * 2;
+		new_heap = malloc (new_cap * sizeof *new_heap);
+		if (new_heap == NULL)
+			PANIC ("thread_sleep: out of memory for sleep queue");
+
+		old_level = intr_disable ();
+		if (new_cap > sleep_cap) {
+			memcpy (new_heap, sleep_heap, sleep_cnt * sizeof *new_heap);
+			old_heap = sleep_heap;
+			sleep_heap = new_heap;
+			sleep_cap = new_cap;
+		} else
+			old_heap = new_heap;
+		intr_set_level (old_level);
+
+		if (old_heap != sleep_heap_init)
+			free (old_heap);
+	}
+}
 
-        if (holder->priority < curr->priority) {
-            holder->priority = curr->priority;  // 우선순위 기부
-        }
+/* Inserts T into the sleep heap, which must have room for it.
+   Interrupts must be off. */
+static void
+sleep_heap_push (struct thread *t) {
+	size_t i;
 
-        curr = holder;
-    }
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (sleep_cnt < sleep_cap);
+
+	/* Sift up. */
+	for (i = sleep_cnt++; i > 0; i = (i - 1) / 2) {
+		struct thread *parent = sleep_heap[(i - 1) / 2];
+		if (!sleep_before (t, parent))
+			break;
+		sleep_heap[i] = parent;
+	}
+	sleep_heap[i] = t;
 }
 
+/* Removes and returns the thread with the earliest awake_ticks.
+   The heap must be nonempty.  Interrupts must be off. */
+static struct thread *
+sleep_heap_pop (void) {
+	struct thread *top, *last;
+	size_t i, child;
 
-/* running 상태에서 wait_list로 옮기기 */
-void thread_wait() {
-	enum intr_level old_level = intr_disable();
-	list_insert_ordered(&wait_list, &thread_current()->elem, cmp_priority_wait, NULL);
-	thread_block();
-	intr_set_level (old_level);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (sleep_cnt > 0);
+
+	top = sleep_heap[0];
+	last = sleep_heap[--sleep_cnt];
+
+	/* Sift the former last element down from the root. */
+	for (i = 0; (child = 2 * i + 1) < sleep_cnt; i = child) {
+		if (child + 1 < sleep_cnt
+				&& sleep_before (sleep_heap[child + 1], sleep_heap[child]))
+			child++;
+		if (!sleep_before (sleep_heap[child], last))
+			break;
+		sleep_heap[i] = sleep_heap[child];
+	}
+	sleep_heap[i] = last;
+
+	return top;
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -314,7 +616,7 @@ thread_block (void) {
 	ASSERT (!intr_context ());
 	ASSERT (intr_get_level () == INTR_OFF);
 	thread_current ()->status = THREAD_BLOCKED;
-	schedule ();
+	schedule (false);
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -333,7 +635,8 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	list_insert_ordered(&ready_list, &t->elem, cmp_priority_ready, NULL);
+	t->ready_since = rdtsc ();
+	ready_queue_push (t);
 	t->status = THREAD_READY;
 	intr_set_level (old_level);
 }
@@ -379,9 +682,24 @@ thread_exit (void) {
 #endif
 
 	/* Just set our status to dying and schedule another process.
-	   We will be destroyed during the call to schedule_tail(). */
+	   The reaper will recycle us once we are off the CPU. */
 	intr_disable ();
-	do_schedule (THREAD_DYING);
+	struct thread *curr = thread_current ();
+	list_remove (&curr->allelem);
+
+	/* Unlink from our parent and orphan our children, so that no
+	   child list keeps pointing into a recycled page. */
+	if (curr->parent != NULL)
+		list_remove (&curr->child_elem);
+	while (!list_empty (&curr->child_list))
+		list_entry (list_pop_front (&curr->child_list),
+				struct thread, child_elem)->parent = NULL;
+
+	if (reaper_waiting) {
+		reaper_waiting = false;
+		thread_unblock (reaper_thread);
+	}
+	do_schedule (THREAD_DYING, false);
 	NOT_REACHED ();
 }
 
@@ -389,41 +707,83 @@ thread_exit (void) {
    may be scheduled again immediately at the scheduler's whim. */
 void
 thread_yield (void) {
-	struct thread *curr = thread_current ();
-	enum intr_level old_level;
+	ASSERT (!intr_context ());
 
+	yield_current (false);
+}
+
+/* Like thread_yield(), but for a thread that is being forced off
+   the CPU, e.g. at the end of its time slice or because a higher
+   priority thread became ready.  Called by the interrupt handler
+   on the way out of an external interrupt, and accounted as an
+   involuntary context switch. */
+void
+thread_preempt (void) {
 	ASSERT (!intr_context ());
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	yield_current (true);
+}
+
+/* Puts the running thread back on the run queue and schedules.
+   PREEMPTED tells whether the thread is being forced off the CPU. */
+static void
+yield_current (bool preempted) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
-		list_insert_ordered(&ready_list, &curr->elem, cmp_priority_ready, NULL);
-	do_schedule (THREAD_READY);
+	if (curr != idle_thread) {
+		curr->ready_since = rdtsc ();
+		ready_queue_push (curr);
+	}
+	do_schedule (THREAD_READY, preempted);
 	intr_set_level (old_level);
 }
 
-struct list* thread_get_wait_list(void) {			/* wait list의 주소 반환 */
-	return &wait_list;
+bool check_priority_threads() {
+    return thread_current()->priority < ready_queue_max_priority();
 }
 
+/* Sets T's effective priority to PRIORITY.  If T is sitting in
+   the run queue it is moved to the queue for its new priority,
+   and if it is waiting on a semaphore or condition variable its
+   place among the waiters is fixed up, so every change to a
+   thread's priority must go through here. */
+void
+thread_change_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
 
-bool check_priority_threads() {
-    if (!list_empty(&ready_list)) {
-        if (thread_current()->priority < list_entry(list_front(&ready_list), struct thread, elem)->priority) {
-            return true;
-        }
-    }
-    return false;
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	if (t->priority != priority) {
+		if (t->status == THREAD_READY) {
+			ready_queue_remove (t);
+			t->priority = priority;
+			ready_queue_push (t);
+		} else
+			t->priority = priority;
+		synch_priority_changed (t);
+	}
+	intr_set_level (old_level);
 }
 
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) {
-	thread_current() -> priority = new_priority;
-	thread_current() -> init_priority = new_priority;
+	/* The MLFQS scheduler computes priorities by itself. */
+	if (thread_mlfqs)
+		return;
 
-	refresh_priority();
-	test_max_priority();
+	enum intr_level old_level = intr_disable ();
+	thread_current ()->init_priority = new_priority;
+	refresh_priority ();
+	intr_set_level (old_level);
+
+	test_max_priority ();
 }
 
 /* Returns the current thread's priority. */
@@ -432,31 +792,46 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it is no longer the highest. */
 void
-thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
+thread_set_nice (int nice) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+	old_level = intr_disable ();
+	curr->nice = nice;
+	if (thread_mlfqs)
+		mlfqs_update_priority (curr);
+	intr_set_level (old_level);
+
+	test_max_priority ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int load = fp_round (fp_mul_int (load_avg, 100));
+	intr_set_level (old_level);
+	return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+	intr_set_level (old_level);
+	return recent;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -481,18 +856,107 @@ idle (void *idle_started_ UNUSED) {
 		thread_block ();
 
 		/* Re-enable interrupts and wait for the next one.
+		   In tickless mode the timer may stop ticking until the
+		   earliest sleeper is due. */
+		timer_idle ();
+	}
+}
 
-		   The `sti' instruction disables interrupts until the
-		   completion of the next instruction, so these two
-		   instructions are executed atomically.  This atomicity is
-		   important; otherwise, an interrupt could be handled
-		   between re-enabling interrupts and waiting for the next
-		   one to occur, wasting as much as one clock tick worth of
-		   time.
-
-		   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-		   7.11.1 "HLT Instruction". */
-		asm volatile ("sti; hlt" : : : "memory");
+/* Reaper thread.  Runs at the lowest priority, so that recycling
+   dead threads is kept off the scheduler's critical path and out
+   of the way of real work.  Waits for thread_exit() to wake it,
+   then moves every thread on destruction_req into the thread
+   cache.  thread_create() also takes pages straight off
+   destruction_req when the cache is empty, so a busy system that
+   never lets the reaper run does not pile up dead pages. */
+static void
+reaper (void *aux UNUSED) {
+	reaper_thread = thread_current ();
+	if (thread_mlfqs)
+		thread_set_nice (NICE_MAX);
+
+	for (;;) {
+		struct thread *victim;
+		enum intr_level old_level = intr_disable ();
+		while (list_empty (&destruction_req)) {
+			reaper_waiting = true;
+			thread_block ();
+		}
+		victim = list_entry (list_pop_front (&destruction_req),
+				struct thread, elem);
+		intr_set_level (old_level);
+
+		thread_recycle (victim);
+		threads_reaped++;
+	}
+}
+
+/* Clears the fd_table of dead thread T so it can be handed out
+   again.  Only the first MAX_FD entries are ever used. */
+static void
+thread_scrub (struct thread *t) {
+	memset (t->fd_table, 0, MAX_FD * sizeof *t->fd_table);
+}
+
+/* Returns a page for a new thread whose fd_table member points to
+   a cleared fd table, or a null pointer if memory is exhausted.
+   The rest of the page is not cleared; init_thread() initializes
+   the struct thread and the stack needs no zeroing. */
+static struct thread *
+thread_alloc (void) {
+	struct thread *t = NULL;
+	enum intr_level old_level;
+	bool scrub = false;
+
+	old_level = intr_disable ();
+	if (!list_empty (&thread_cache)) {
+		t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+		thread_cache_cnt--;
+	} else if (!list_empty (&destruction_req)) {
+		t = list_entry (list_pop_front (&destruction_req), struct thread, elem);
+		scrub = true;
+	}
+	intr_set_level (old_level);
+
+	if (t != NULL) {
+		if (scrub)
+			thread_scrub (t);
+		thread_cache_hits++;
+		return t;
+	}
+
+	thread_cache_misses++;
+	t = palloc_get_page (0);
+	if (t == NULL)
+		return NULL;
+	t->fd_table = palloc_get_multiple (PAL_ZERO, FDT_PAGES);
+	if (t->fd_table == NULL) {
+		palloc_free_page (t);
+		return NULL;
+	}
+	return t;
+}
+
+/* Recycles dead thread T: clears its fd_table and puts it in the
+   thread cache, or frees both if the cache is full. */
+static void
+thread_recycle (struct thread *t) {
+	enum intr_level old_level;
+	bool cached = false;
+
+	thread_scrub (t);
+
+	old_level = intr_disable ();
+	if (thread_cache_cnt < THREAD_CACHE_MAX) {
+		list_push_front (&thread_cache, &t->elem);
+		thread_cache_cnt++;
+		cached = true;
+	}
+	intr_set_level (old_level);
+
+	if (!cached) {
+		palloc_free_multiple (t->fd_table, FDT_PAGES);
+		palloc_free_page (t);
 	}
 }
 
@@ -524,13 +988,26 @@ init_thread (struct thread *t, const char *name, int priority) {
 
 	t->init_priority = priority;
 	t->wait_on_lock = NULL;
-	list_init(&t->donations);
+	synch_thread_init (t);
+
+	/* A new thread inherits its parent's nice and recent_cpu; under
+	   MLFQS its priority follows from those, not from PRIORITY. */
+	if (t != running_thread ()) {
+		t->nice = running_thread ()->nice;
+		t->recent_cpu = running_thread ()->recent_cpu;
+	}
+	if (thread_mlfqs) {
+		mlfqs_update_priority (t);
+		t->init_priority = t->priority;
+	}
+
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&all_list, &t->allelem);
+	intr_set_level (old_level);
 
 	t->exit_status = 0;//해당 구조체 멤버값을 인자로 받은 status을 넣어준 뒤 thread_exit()을 실행한다
 	t->fd = 2;
 
-	// t->donation_elem.prev = list_head;
-	// t->donation_elem.next = list_tail;
 	list_init(&t->child_list);
 	sema_init(&t->load_sema, 0);
 	sema_init(&t->exit_sema, 0);
@@ -545,12 +1022,69 @@ init_thread (struct thread *t, const char *name, int priority) {
    will be in the run queue.)  If the run queue is empty, return
    idle_thread. */
 static struct thread *
-
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
+	int pri = ready_queue_max_priority ();
+	struct thread *t;
+
+	if (pri < PRI_MIN)
 		return idle_thread;
-	else
-		return list_entry(list_pop_front(&ready_list), struct thread, elem);
+
+	t = list_entry (list_pop_front (&ready_queues[pri]), struct thread, elem);
+	if (list_empty (&ready_queues[pri]))
+		ready_bitmap &= ~(1ULL << pri);
+	ready_cnt--;
+
+	/* Account the time T spent waiting in the run queue. */
+	int bucket = ready_hist_bucket (rdtsc () - t->ready_since);
+	t->ready_hist[bucket]++;
+	ready_hist[bucket]++;
+	return t;
+}
+
+/* Returns the latency histogram bucket for a run-queue wait of
+   CYCLES TSC cycles.  Buckets grow by powers of 4 starting at
+   4096 cycles: bucket 0 is below 4K cycles, bucket 1 below 16K,
+   and so on; the last bucket holds everything longer. */
+static int
+ready_hist_bucket (uint64_t cycles) {
+	int bucket = 0;
+
+	for (cycles >>= 12; cycles != 0 && bucket < READY_HIST_BUCKETS - 1;
+			cycles >>= 2)
+		bucket++;
+	return bucket;
+}
+
+/* Appends T to the tail of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_push_back (&ready_queues[t->priority], &t->elem);
+	ready_bitmap |= 1ULL << t->priority;
+	ready_cnt++;
+}
+
+/* Removes T, which must be in the run queue for its current
+   priority, from the run queue.  Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_remove (&t->elem);
+	if (list_empty (&ready_queues[t->priority]))
+		ready_bitmap &= ~(1ULL << t->priority);
+	ready_cnt--;
+}
+
+/* Returns the highest priority of any ready thread, or
+   PRI_MIN - 1 if the run queue is empty. */
+static int
+ready_queue_max_priority (void) {
+	if (ready_bitmap == 0)
+		return PRI_MIN - 1;
+	return 63 - __builtin_clzll (ready_bitmap);
 }
 
 /* Use iretq to launch the thread */
@@ -593,10 +1127,24 @@ do_iret (struct intr_frame *tf) {
    added at the end of the function. */
 static void
 thread_launch (struct thread *th) {
-	uint64_t tf_cur = (uint64_t) &running_thread ()->tf;
+	struct thread *curr = running_thread ();
+	uint64_t tf_cur = (uint64_t) &curr->tf;
 	uint64_t tf = (uint64_t) &th->tf;
 	ASSERT (intr_get_level () == INTR_OFF);
 
+	/* Both threads are in the kernel, so unless TH is starting
+	   for the first time only the callee-saved registers need to
+	   be switched.  switch_threads() falls back to do_iret() for
+	   a first launch by itself. */
+	if (thread_fast_switch) {
+		switch_threads (&curr->switch_rsp, th->switch_rsp, &th->tf);
+		return;
+	}
+
+	/* Full intr_frame path.  CURR's context goes into its tf, so
+	   it must be resumed through do_iret() as well. */
+	curr->switch_rsp = 0;
+
 	/* The main switching logic.
 	 * We first restore the whole execution context into the intr_frame
 	 * and then switching to the next thread by calling do_iret.
@@ -652,26 +1200,22 @@ thread_launch (struct thread *th) {
 
 /* Schedules a new process. At entry, interrupts must be off.
  * This function modify current thread's status to status and then
- * finds another thread to run and switches to it.
+ * finds another thread to run and switches to it.  PREEMPTED is
+ * true if the current thread is being forced off the CPU, which
+ * counts as an involuntary context switch.
  * It's not safe to call printf() in the schedule(). */
 
 /* 현재 running 상태인 스레드의 상태를 변경하는 함수 */
 static void
-do_schedule(int status) {
+do_schedule(int status, bool preempted) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (thread_current()->status == THREAD_RUNNING);
-	/* CPU에서 실행 중인 스레드가 사용 중인 자원에 접근하여 해제하는 일은 위험하기 때문에 일단 destruction_req 리스트에 종료된 스레드들을 넣어놓고 나중에 처리함 */
-	while (!list_empty (&destruction_req)) {
-		struct thread *victim =
-			list_entry (list_pop_front (&destruction_req), struct thread, elem);
-		palloc_free_page(victim);
-	}
 	thread_current ()->status = status;
-	schedule ();
+	schedule (preempted);
 }
 
 static void
-schedule (void) {
+schedule (bool preempted) {
 	struct thread *curr = running_thread ();
 	struct thread *next = next_thread_to_run ();
 
@@ -681,6 +1225,14 @@ schedule (void) {
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
 
+	if (curr != next) {
+		if (curr->status == THREAD_READY && preempted)
+			curr->nivcsw++;
+		else
+			curr->nvcsw++;
+		sched_trace_record (curr, next, preempted);
+	}
+
 	/* Start new time slice. */
 	thread_ticks = 0;
 
@@ -693,10 +1245,8 @@ schedule (void) {
 		/* If the thread we switched from is dying, destroy its struct
 		   thread. This must happen late so that thread_exit() doesn't
 		   pull out the rug under itself.
-		   We just queuing the page free reqeust here because the page is
-		   currently used by the stack.
-		   The real destruction logic will be called at the beginning of the
-		   schedule(). */
+		   We just queue the thread here because its page is currently
+		   used by the stack.  The reaper thread recycles it later. */
 		if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
 			ASSERT (curr != next);
 			list_push_back (&destruction_req, &curr->elem);
@@ -708,6 +1258,66 @@ schedule (void) {
 	}
 }
 
+/* Appends the switch from PREV to NEXT to the scheduler trace;
+   PREEMPTED tells whether PREV was forced off the CPU.  Called
+   by schedule() with interrupts off, before PREV's status is
+   overwritten. */
+static void
+sched_trace_record (struct thread *prev, struct thread *next,
+		bool preempted) {
+	struct sched_event *ev = &sched_trace[sched_trace_cnt++ % SCHED_TRACE_SIZE];
+
+	ev->tick = timer_ticks ();
+	ev->prev = prev->tid;
+	ev->next = next->tid;
+	if (prev->status == THREAD_BLOCKED)
+		ev->reason = SCHED_BLOCK;
+	else if (prev->status == THREAD_DYING)
+		ev->reason = SCHED_EXIT;
+	else if (preempted)
+		ev->reason = SCHED_PREEMPT;
+	else
+		ev->reason = SCHED_YIELD;
+}
+
+/* Prints per-thread CPU accounting for every live thread, the
+   global ready-queue latency histogram, and the scheduler trace
+   from oldest to newest event. */
+void
+thread_print_trace (void) {
+	static const char *reasons[] = { "block", "yield", "preempt", "exit" };
+	unsigned long long first, i;
+	struct list_elem *e;
+	int b;
+
+	printf ("Threads:\n");
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, allelem);
+		printf ("  %3d %-16s %6lld ticks, %u voluntary, %u involuntary,"
+				" ready latency", t->tid, t->name, (long long) t->run_ticks,
+				t->nvcsw, t->nivcsw);
+		for (b = 0; b < READY_HIST_BUCKETS; b++)
+			printf (" %u", t->ready_hist[b]);
+		printf ("\n");
+	}
+
+	printf ("Ready latency (cycles, <4K <16K <64K <256K <1M <4M <16M more):");
+	for (b = 0; b < READY_HIST_BUCKETS; b++)
+		printf (" %lld", ready_hist[b]);
+	printf ("\n");
+
+	first = sched_trace_cnt > SCHED_TRACE_SIZE
+		? sched_trace_cnt - SCHED_TRACE_SIZE : 0;
+	printf ("Scheduler trace: last %llu of %llu switches\n",
+			sched_trace_cnt - first, sched_trace_cnt);
+	for (i = first; i < sched_trace_cnt; i++) {
+		struct sched_event *ev = &sched_trace[i % SCHED_TRACE_SIZE];
+		printf ("  %8lld %4d -> %-4d %s\n", (long long) ev->tick,
+				ev->prev, ev->next, reasons[ev->reason]);
+	}
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) {
@@ -721,37 +1331,22 @@ allocate_tid (void) {
 	return tid;
 }
 
-bool
-thread_compare_donate_priority (const struct list_elem *l, 
-				const struct list_elem *s, void *aux UNUSED)
-{
-	return list_entry (l, struct thread, donation_elem)->priority
-		 > list_entry (s, struct thread, donation_elem)->priority;
-}
-
-void remove_with_lock (struct lock *lock)
-{
-  struct list_elem *e;
-  struct thread *cur = thread_current ();
-
-  for (e = list_begin (&cur->donations); e != list_end (&cur->donations); e = list_next (e)){
-    struct thread *t = list_entry (e, struct thread, donation_elem);
-    if (t->wait_on_lock == lock)
-      list_remove (&t->donation_elem);
-  }
-}
-
-void refresh_priority (void)
-{
-  struct thread *cur = thread_current ();
-
-  cur->priority = cur->init_priority;
-  
-  if (!list_empty (&cur->donations)) {
-    list_sort (&cur->donations, thread_compare_donate_priority, 0);
-
-    struct thread *front = list_entry (list_front (&cur->donations), struct thread, donation_elem);
-    if (front->priority > cur->priority)
-      cur->priority = front->priority;
-  }
+/* Recomputes the running thread's priority from its base
+   priority and the highest priority waiting on any lock it holds,
+   which is the front of its held_locks queue. */
+void
+refresh_priority (void) {
+	struct thread *cur = thread_current ();
+	int priority = cur->init_priority;
+
+	if (thread_mlfqs)
+		return;
+
+	if (!pq_empty (&cur->held_locks)) {
+		struct lock *top = pq_entry (pq_front (&cur->held_locks),
+				struct lock, held_elem);
+		if (top->max_priority > priority)
+			priority = top->max_priority;
+	}
+	thread_change_priority (cur, priority);
 }
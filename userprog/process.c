@@ -13,6 +13,7 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -27,6 +28,20 @@ static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
 
+/* Statistics. */
+static long long exec_cnt;              /* Successful process_exec()s. */
+static long long exec_cycles;           /* Their total time to user mode. */
+static long long segment_pages;         /* ELF segment pages set up. */
+static long long segment_pages_loaded;  /* ... and read from the file. */
+
+/* Adds 1 to *STAT.  Processes update statistics concurrently. */
+static void
+count_stat (long long *stat) {
+	enum intr_level old_level = intr_disable ();
+	(*stat)++;
+	intr_set_level (old_level);
+}
+
 /* General process initializer for initd and other process. */
 static void
 process_init (void) {
@@ -198,6 +213,14 @@ __do_fork (void *aux) {
 		goto error;
 
 	process_activate (current);
+
+	/* The child keeps its own handle on the executable, which also
+	 * keeps it from being written while the child runs. */
+	if (parent->running != NULL) {
+		current->running = file_duplicate (parent->running);
+		if (current->running == NULL)
+			goto error;
+	}
 #ifdef VM
 	supplemental_page_table_init (&current->spt);
 	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
@@ -247,6 +270,7 @@ error:
 /* Switch the current execution context to the f_name.
  * Returns -1 on fail. */
 int process_exec(void *f_name) {
+    uint64_t start = rdtsc ();
     char *file_name = f_name;
     bool success;
 		char *saveptr;
@@ -277,6 +301,14 @@ int process_exec(void *f_name) {
     _if.eflags = FLAG_IF | FLAG_MBS;
 
     process_cleanup();
+#ifdef VM
+    /* process_cleanup() tore down the old address space's table. */
+    supplemental_page_table_init (&thread_current ()->spt);
+#endif
+    /* Let go of the old executable, which a forked child holds its
+     * own handle on, so that it can be written again. */
+    file_close (thread_current ()->running);
+    thread_current ()->running = NULL;
 	
     success = load(parse[0], &_if);  // 첫 번째 인자(프로그램 이름)를 사용
     if (!success) {
@@ -292,6 +324,11 @@ int process_exec(void *f_name) {
 		_if.R.rsi = _if.rsp + sizeof(void*);
     palloc_free_page(file_name);
 
+    enum intr_level old_level = intr_disable ();
+    exec_cnt++;
+    exec_cycles += rdtsc () - start;
+    intr_set_level (old_level);
+
     do_iret(&_if);
     NOT_REACHED();
 }
@@ -389,7 +426,10 @@ process_wait (tid_t child_tid UNUSED) {
 	}
 	sema_down(&child->wait_sema);
 	int exit_status = child->exit_status;
+	enum intr_level old_level = intr_disable();
 	list_remove(&child->child_elem);
+	child->parent = NULL;
+	intr_set_level(old_level);
 	sema_up(&child->exit_sema);
 	return exit_status;
 }
@@ -402,7 +442,7 @@ void process_exit(void)
     // 1) FDT의 모든 파일을 닫고 메모리를 반환한다.
     for (int i = 2; i < FDT_COUNT_LIMIT; i++)
         close(i);
-    palloc_free_page(curr->fd_table);
+    // fd_table은 스레드 페이지와 함께 reaper가 재활용한다.
     file_close(curr->running); // 2) 현재 실행 중인 파일도 닫는다.
     process_cleanup();
     // 3) 자식이 종료될 때까지 대기하고 있는 부모에게 signal을 보낸다.
@@ -439,12 +479,28 @@ process_cleanup (void) {
 	}
 }
 
+/* Prints exec statistics: how long exec took to reach the new
+ * program's first instruction, and how many pages of its
+ * segments were actually read from the executable. */
+void
+process_print_stats (void) {
+	printf ("Exec: %lld programs started, %lld cycles each to first "
+			"instruction\n", exec_cnt, exec_cnt ? exec_cycles / exec_cnt : 0);
+	printf ("Exec: %lld of %lld segment pages loaded\n",
+			segment_pages_loaded, segment_pages);
+}
+
 /* Sets up the CPU for running user code in the nest thread.
  * This function is called on every context switch. */
 void
 process_activate (struct thread *next) {
-	/* Activate thread's page tables. */
-	pml4_activate (next->pml4);
+	/* Activate thread's page tables.  A kernel thread has no user
+	 * address space of its own, so it keeps running on whichever
+	 * page tables are loaded; they all map the kernel the same way,
+	 * and a process switches to base_pml4 before it destroys its
+	 * own. */
+	if (next->pml4 != NULL)
+		pml4_activate (next->pml4);
 
 	/* Set thread's kernel stack for use in processing interrupts. */
 	tss_update (next);
@@ -726,6 +782,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 			palloc_free_page (kpage);
 			return false;
 		}
+		count_stat (&segment_pages);
+		count_stat (&segment_pages_loaded);
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
@@ -775,11 +833,27 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Fills PAGE, which is being claimed for the first time, from
+ * the executable as described by AUX, a struct file_load_aux. */
 static bool
 lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct file_load_aux *load = aux;
+	uint8_t *kva = page->frame->kva;
+	bool locked = lock_held_by_current_thread (&filesys_lock);
+	bool success;
+
+	/* A read() system call holds the file system lock while it
+	 * copies into a user buffer that may fault its pages in. */
+	if (!locked)
+		lock_acquire (&filesys_lock);
+	success = file_read_at (load->file, kva, load->read_bytes, load->ofs)
+		== (off_t) load->read_bytes;
+	if (!locked)
+		lock_release (&filesys_lock);
+
+	/* anon_initializer() has zeroed the rest of the page. */
+	count_stat (&segment_pages_loaded);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -803,6 +877,11 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
+	if (!spt_add_region (&thread_current ()->spt, upage,
+				upage + read_bytes + zero_bytes,
+				writable ? VM_REGION_DATA : VM_REGION_CODE))
+		return false;
+
 	while (read_bytes > 0 || zero_bytes > 0) {
 		/* Do calculate how to fill this page.
 		 * We will read PAGE_READ_BYTES bytes from FILE
@@ -810,16 +889,27 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
+		/* Nothing is read until the page is first touched.  A page
+		 * of zeros needs no initializer at all. */
+		struct file_load_aux *aux = NULL;
+		if (page_read_bytes > 0) {
+			aux = malloc (sizeof *aux);
+			if (aux == NULL)
+				return false;
+			aux->file = file;
+			aux->ofs = ofs;
+			aux->read_bytes = page_read_bytes;
+		}
+		if (!vm_alloc_page_with_initializer (VM_ANON, upage, writable,
+					aux != NULL ? lazy_load_segment : NULL, aux))
 			return false;
+		count_stat (&segment_pages);
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -830,11 +920,14 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	/* The arguments are pushed right away, so claim the page now. */
+	if (spt_add_region (&thread_current ()->spt, stack_bottom,
+				(void *) USER_STACK, VM_REGION_STACK)
+			&& vm_alloc_page (VM_ANON, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
@@ -1,7 +1,16 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <bitmap.h>
 #include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "devices/disk.h"
+#include "intrinsic.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,11 +26,52 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* The swap disk is divided into page-sized slots. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+#define SLOT_NONE SIZE_MAX
+
+static size_t slot_cnt;                 /* Number of slots. */
+static struct bitmap *slot_used;        /* Slots in use. */
+static int *slot_refs;                  /* Number of pages in each slot. */
+static struct page **slot_owner;        /* Page in each slot, if just one. */
+static size_t slot_cursor;              /* Where to look for slots next. */
+
+/* Protects the slot tables.  Acquired after frame_lock, if both
+ * are needed, and never held across disk I/O. */
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long pages_written;         /* Pages written to swap. */
+static long long pages_dropped;         /* Clean pages evicted unwritten. */
+static long long write_batches;         /* Batches with a write. */
+static long long write_cycles;          /* Cycles spent writing. */
+static long long pages_read;            /* Pages read from swap. */
+static long long read_cycles;           /* Cycles spent reading. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	lock_init (&swap_lock);
+	swap_disk = disk_get (1, 1);
+	if (swap_disk == NULL)
+		return;
+
+	slot_cnt = disk_size (swap_disk) / SECTORS_PER_PAGE;
+	slot_used = bitmap_create (slot_cnt);
+	slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+	slot_owner = calloc (slot_cnt, sizeof *slot_owner);
+	if (slot_used == NULL || slot_refs == NULL || slot_owner == NULL)
+		PANIC ("swap: out of memory for %zu slots", slot_cnt);
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	printf ("Swap: %lld pages written in %lld batches, %lld cycles each, "
+			"%lld clean pages dropped\n", pages_written, write_batches,
+			pages_written ? write_cycles / pages_written : 0, pages_dropped);
+	printf ("Swap: %lld pages read, %lld cycles each\n",
+			pages_read, pages_read ? read_cycles / pages_read : 0);
 }
 
 /* Initialize the file mapping */
@@ -31,22 +81,266 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SLOT_NONE;
+
+	/* A new anonymous page reads as zeros, except for whatever the
+	 * page's own initializer writes over them. */
+	memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Drops one page's claim on SLOT, freeing it once no page has
+ * one.  Must be called with swap_lock held. */
+static void
+slot_put (size_t slot) {
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	ASSERT (slot_refs[slot] > 0);
+	slot_owner[slot] = NULL;
+	if (--slot_refs[slot] == 0)
+		bitmap_reset (slot_used, slot);
+}
+
+/* Allocates CNT consecutive slots and returns the first, or
+ * SLOT_NONE if there is no such run.  Must be called with
+ * swap_lock held. */
+static size_t
+slot_alloc (size_t cnt) {
+	size_t slot;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	slot = bitmap_scan_next_fit (slot_used, &slot_cursor, cnt, false);
+	if (slot == BITMAP_ERROR)
+		return SLOT_NONE;
+	bitmap_set_multiple (slot_used, slot, cnt, true);
+	return slot;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->slot;
+	uint64_t start;
+
+	if (slot == SLOT_NONE)
+		return false;
+
+	start = rdtsc ();
+	for (size_t i = 0; i < SECTORS_PER_PAGE; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_PAGE + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
+
+	/* A slot no other page shares stays as a copy of the page, so
+	 * that evicting the page again costs no write until it is
+	 * dirtied.  A slot that fork shared goes stale as soon as any of
+	 * its pages is written, so this page lets go of it. */
+	lock_acquire (&swap_lock);
+	if (slot_refs[slot] > 1) {
+		slot_put (slot);
+		anon_page->slot = SLOT_NONE;
+	}
+	pages_read++;
+	read_cycles += rdtsc () - start;
+	lock_release (&swap_lock);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	bool success;
+
+	anon_swap_out_batch (&page->frame, 1, &success);
+	return success;
+}
+
+/* Calls FUNC on each page that FRAME backs. */
+static void
+frame_for_each_page (struct frame *frame, void (*func) (struct page *, void *),
+		void *aux) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		func (list_entry (e, struct page, frame_elem), aux);
+}
+
+/* frame_for_each_page() helper that unmaps PAGE. */
+static void
+page_unmap (struct page *page, void *aux UNUSED) {
+	pml4_clear_page (page->pml4, page->va);
+}
+
+/* frame_for_each_page() helper that maps PAGE again, as it was
+ * before page_unmap(): read-only while fork shares its frame. */
+static void
+page_remap (struct page *page, void *aux UNUSED) {
+	struct frame *frame = page->frame;
+
+	pml4_set_page (page->pml4, page->va, frame->kva,
+			frame->page_cnt == 1 && page->writable);
+}
+
+/* frame_for_each_page() helper that drops PAGE's slot, if any.
+ * Must be called with swap_lock held. */
+static void
+page_put_slot (struct page *page, void *aux UNUSED) {
+	if (page->anon.slot != SLOT_NONE) {
+		slot_put (page->anon.slot);
+		page->anon.slot = SLOT_NONE;
+	}
+}
+
+/* frame_for_each_page() helper that sets PAGE's slot to *SLOT. */
+static void
+page_set_slot (struct page *page, void *slot) {
+	page->anon.slot = *(size_t *) slot;
+}
+
+/* Evicts the CNT frames in FRAMES, setting SUCCESS[i] to whether
+ * the pages of the i'th frame now live in swap alone, or are still
+ * mapped as before.  A frame that backs a single clean page that
+ * still has its slot needs no write.  The rest are written to one
+ * run of consecutive slots if there is one, so that the disk sees
+ * a single sequential write, and all the pages a frame backs share
+ * its slot.  The caller must hold frame_lock, so that none of the
+ * pages goes away. */
+void
+anon_swap_out_batch (struct frame **frames, size_t cnt, bool *success) {
+	bool dirty[SWAP_BATCH_MAX];
+	size_t dirty_cnt = 0, run, i, next;
+	uint64_t start = rdtsc ();
+
+	ASSERT (cnt <= SWAP_BATCH_MAX);
+
+	if (swap_disk == NULL) {
+		for (i = 0; i < cnt; i++)
+			success[i] = false;
+		return;
+	}
+
+	/* Unmap first: once the processes can no longer write to the
+	 * pages, their dirty bits are final.  Only a page no other page
+	 * shares a frame with can have a slot. */
+	for (i = 0; i < cnt; i++)
+		frame_for_each_page (frames[i], page_unmap, NULL);
+	for (i = 0; i < cnt; i++) {
+		struct page *page = frames[i]->page;
+		dirty[i] = frames[i]->page_cnt > 1
+			|| page->anon.slot == SLOT_NONE
+			|| pml4_is_dirty (page->pml4, page->va);
+		dirty_cnt += dirty[i];
+		success[i] = true;
+	}
+
+	lock_acquire (&swap_lock);
+	for (i = 0; i < cnt; i++)
+		if (dirty[i])
+			frame_for_each_page (frames[i], page_put_slot, NULL);
+	run = dirty_cnt > 0 ? slot_alloc (dirty_cnt) : SLOT_NONE;
+	for (i = 0, next = run; i < cnt; i++) {
+		struct frame *frame = frames[i];
+		size_t slot;
+
+		if (!dirty[i])
+			continue;
+		slot = run != SLOT_NONE ? next++ : slot_alloc (1);
+		if (slot != SLOT_NONE) {
+			slot_refs[slot] = frame->page_cnt;
+			slot_owner[slot] = frame->page_cnt == 1 ? frame->page : NULL;
+		}
+		frame_for_each_page (frame, page_set_slot, &slot);
+	}
+	lock_release (&swap_lock);
+
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = frames[i];
+		size_t slot = frame->page->anon.slot;
+
+		if (!dirty[i])
+			continue;
+		if (slot == SLOT_NONE) {
+			/* The swap disk is full: leave the pages where they
+			 * were.  Remapping cannot fail, since the page table
+			 * entries are still there. */
+			frame_for_each_page (frame, page_remap, NULL);
+			success[i] = false;
+			continue;
+		}
+		for (size_t s = 0; s < SECTORS_PER_PAGE; s++)
+			disk_write (swap_disk, slot * SECTORS_PER_PAGE + s,
+					(uint8_t *) frame->kva + s * DISK_SECTOR_SIZE);
+	}
+
+	lock_acquire (&swap_lock);
+	for (i = 0; i < cnt; i++)
+		if (!dirty[i])
+			pages_dropped++;
+		else if (success[i])
+			pages_written++;
+	if (dirty_cnt > 0) {
+		write_batches++;
+		write_cycles += rdtsc () - start;
+	}
+	lock_release (&swap_lock);
+}
+
+/* Stores in PAGES up to MAX pages of PAGE's process that are
+ * swapped out to the slots just after PAGE's, in slot order, and
+ * returns how many it found.  Reading them in along with PAGE
+ * costs little more than reading PAGE alone. */
+size_t
+anon_swap_neighbours (struct page *page, struct page **pages, size_t max) {
+	size_t slot = page->anon.slot, cnt = 0;
+
+	if (slot == SLOT_NONE)
+		return 0;
+
+	lock_acquire (&swap_lock);
+	for (size_t s = slot + 1; s < slot_cnt && s <= slot + max; s++) {
+		struct page *p = slot_owner[s];
+		if (p != NULL && p->pml4 == page->pml4 && p->frame == NULL)
+			pages[cnt++] = p;
+	}
+	lock_release (&swap_lock);
+	return cnt;
+}
+
+/* Gives CHILD, a copy made by fork of PARENT, its own claim on
+ * PARENT's contents in swap.  A page that is swapped out shares its
+ * slot with the copy.  A page in memory gives up its slot instead,
+ * because the frame it now shares is what the copies read. The
+ * caller must hold frame_lock. */
+void
+anon_fork (struct page *parent, struct page *child) {
+	size_t slot = parent->anon.slot;
+
+	child->anon.slot = SLOT_NONE;
+	if (slot == SLOT_NONE)
+		return;
+
+	lock_acquire (&swap_lock);
+	if (parent->frame != NULL) {
+		slot_put (slot);
+		parent->anon.slot = SLOT_NONE;
+	} else {
+		slot_refs[slot]++;
+		slot_owner[slot] = NULL;
+		child->anon.slot = slot;
+	}
+	lock_release (&swap_lock);
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	vm_free_frame (page);
+	if (anon_page->slot != SLOT_NONE) {
+		lock_acquire (&swap_lock);
+		slot_put (anon_page->slot);
+		lock_release (&swap_lock);
+		anon_page->slot = SLOT_NONE;
+	}
 }
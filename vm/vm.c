@@ -1,9 +1,50 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <string.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* The frame table: every frame that backs a mapped user page, in
+ * the order the clock hand visits them.  Frames that are being
+ * filled are not in it yet. */
+static struct list frame_table;
+static struct list_elem *clock_hand;    /* Next frame the clock visits. */
+
+/* Protects the frame table and the page lists of all frames,
+ * which pages of different processes share after fork. */
+static struct lock frame_lock;
+
+/* Statistics. */
+static long long cow_shared;            /* Pages shared by fork. */
+static long long cow_copied;            /* Write faults that copied. */
+static long long cow_reused;            /* Write faults on unshared frames. */
+static long long evictions;             /* Pages evicted. */
+static long long frames_scanned;        /* Frames the clock looked at. */
+static size_t max_scan;                 /* Most frames one eviction scanned. */
+static long long swap_readahead;        /* Pages read in ahead of faults. */
+
+/* Most pages read in from swap along with a faulting page. */
+#define SWAP_READAHEAD 3
+
+static void frame_track (struct frame *);
+static void frame_untrack (struct frame *);
+static bool frame_detach (struct page *);
+static void frame_free (struct frame *);
+
+/* Adds 1 to *STAT. */
+static void
+count_stat (long long *stat) {
+	enum intr_level old_level = intr_disable ();
+	(*stat)++;
+	intr_set_level (old_level);
+}
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +56,20 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	lock_init (&frame_lock);
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %lld pages shared by fork, %lld copied on write, "
+			"%lld made writable in place\n",
+			cow_shared, cow_copied, cow_reused);
+	printf ("VM: %lld evictions, %lld frames scanned, %zu at most\n",
+			evictions, frames_scanned, max_scan);
+	printf ("VM: %lld pages read ahead from swap\n", swap_readahead);
+	anon_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -39,83 +93,426 @@ static struct frame *vm_evict_frame (void);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
- * `vm_alloc_page`. */
+ * `vm_alloc_page`.
+ * AUX must be null or a struct file_load_aux from malloc(), which
+ * the page then owns and fork knows how to copy. */
 bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
 
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
-	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct thread *curr = thread_current ();
+	struct supplemental_page_table *spt = &curr->spt;
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
-
-		/* TODO: Insert the page into the spt. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->pml4 = curr->pml4;
+		page->writable = writable;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
+	/* AUX is ours to free on failure, as it would be on success. */
+	free (aux);
 	return false;
 }
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
+
+	if (spt->pages.buckets == NULL)
+		return NULL;
 
-	return page;
+	key.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
-/* Insert PAGE into spt with validation. */
+/* Insert PAGE into spt with validation.  Fails if SPT already
+ * has a page at PAGE's address. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
+	return spt->pages.buckets != NULL
+		&& hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
+/* Removes PAGE from SPT and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
 	vm_dealloc_page (page);
+}
+
+/* Returns the index of the first region in SPT that ends after
+ * VA, or SPT's region count if there is none.  Regions do not
+ * overlap, so their ends are sorted as well as their starts. */
+static size_t
+region_search (const struct supplemental_page_table *spt, const void *va) {
+	size_t lo = 0, hi = spt->region_cnt;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if ((const uint8_t *) spt->regions[mid].end <= (const uint8_t *) va)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Returns true if no region of SPT overlaps [START, END). */
+bool
+spt_range_is_free (struct supplemental_page_table *spt,
+		const void *start, const void *end) {
+	size_t i = region_search (spt, start);
+	return i >= spt->region_cnt
+		|| (const uint8_t *) spt->regions[i].start >= (const uint8_t *) end;
+}
+
+/* Returns the region of SPT that contains VA, or a null pointer
+ * if there is none.  The region stays valid until regions are
+ * added to or removed from SPT. */
+struct vm_region *
+spt_find_region (struct supplemental_page_table *spt, const void *va) {
+	size_t i = region_search (spt, va);
+	if (i < spt->region_cnt
+			&& (const uint8_t *) spt->regions[i].start <= (const uint8_t *) va)
+		return &spt->regions[i];
+	return NULL;
+}
+
+/* Adds the page-aligned region [START, END) of kind KIND to SPT.
+ * Returns false if it would overlap another region or if memory
+ * allocation fails. */
+bool
+spt_add_region (struct supplemental_page_table *spt, void *start, void *end,
+		enum vm_region_kind kind) {
+	size_t i;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT ((uint8_t *) start < (uint8_t *) end);
+
+	if (!spt_range_is_free (spt, start, end))
+		return false;
+	if (spt->region_cnt == spt->region_cap) {
+		size_t cap = spt->region_cap ? spt->region_cap * 2 : 8;
+		struct vm_region *regions = realloc (spt->regions,
+				cap * sizeof *regions);
+		if (regions == NULL)
+			return false;
+		spt->regions = regions;
+		spt->region_cap = cap;
+	}
+
+	i = region_search (spt, start);
+	memmove (&spt->regions[i + 1], &spt->regions[i],
+			(spt->region_cnt - i) * sizeof *spt->regions);
+	spt->regions[i] = (struct vm_region) {
+		.start = start,
+		.end = end,
+		.kind = kind,
+	};
+	spt->region_cnt++;
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes REGION, which spt_find_region() returned, from SPT.
+ * The pages in it are not affected. */
+void
+spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region) {
+	size_t i = region - spt->regions;
+
+	ASSERT (i < spt->region_cnt);
+	memmove (&spt->regions[i], &spt->regions[i + 1],
+			(spt->region_cnt - i - 1) * sizeof *spt->regions);
+	spt->region_cnt--;
+}
+
+/* Returns true if the clock may evict FRAME: it is not pinned,
+ * and either it backs a single page or its pages are anonymous,
+ * which can all share one swap slot. */
+static bool
+frame_evictable (const struct frame *frame) {
+	return !frame->pinned && (frame->page_cnt == 1
+			|| VM_TYPE (frame->page->operations->type) == VM_ANON);
+}
+
+/* Returns true if any of the pages FRAME backs was accessed since
+ * the last call, and clears their accessed bits. */
+static bool
+frame_test_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (pml4_is_accessed (page->pml4, page->va)) {
+			pml4_set_accessed (page->pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Returns true if any of the pages FRAME backs was written to. */
+static bool
+frame_is_dirty (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (pml4_is_dirty (page->pml4, page->va))
+			return true;
+	}
+	return false;
+}
+
+/* Returns the frame under the clock hand and advances the hand,
+ * wrapping around at the end of the frame table, which must not
+ * be empty. */
+static struct frame *
+clock_advance (void) {
+	struct list_elem *e;
+
+	if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+		clock_hand = list_begin (&frame_table);
+	e = clock_hand;
+	clock_hand = list_next (e);
+	return list_entry (e, struct frame, elem);
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * Sweeps the clock hand over the frame table.  A frame whose pages
+ * were accessed since the hand last passed gets a second chance:
+ * their accessed bits are cleared and the hand moves on.  Among the
+ * rest, a clean page is taken at once, since dropping it needs no
+ * write-back; a dirty one is only remembered, and taken if a whole
+ * sweep turns up nothing clean.  A second sweep finds every page
+ * not accessed again in the meantime.  Must be called with
+ * frame_lock held. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	struct frame *victim = NULL, *dirty = NULL;
+	size_t frame_cnt = list_size (&frame_table);
+	size_t scanned;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (scanned = 0; scanned < 2 * frame_cnt && victim == NULL; scanned++) {
+		struct frame *frame = clock_advance ();
+
+		if (!frame_evictable (frame))
+			continue;
+		if (!frame_test_accessed (frame)) {
+			if (!frame_is_dirty (frame) || scanned >= frame_cnt)
+				victim = frame;
+			else if (dirty == NULL)
+				dirty = frame;
+		}
+
+		if (victim == NULL && scanned + 1 == frame_cnt && dirty != NULL)
+			victim = dirty;
+	}
 
+	frames_scanned += scanned;
+	if (scanned > max_scan)
+		max_scan = scanned;
 	return victim;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Evict up to SWAP_BATCH_MAX frames and return one of them, which
+ * backs no page any more; the other frames go back to the user
+ * pool, for the faults that are likely to follow.  Anonymous pages
+ * are written out together, one slot per frame however many pages
+ * share it.  Return NULL if nothing can be evicted. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victims[SWAP_BATCH_MAX], *anon[SWAP_BATCH_MAX];
+	struct frame *result = NULL;
+	bool anon_ok[SWAP_BATCH_MAX];
+	size_t victim_cnt = 0, anon_cnt = 0, i, a;
+
+	/* Eviction holds the frame lock throughout, so the victims'
+	 * processes cannot free the pages, nor the frames be shared,
+	 * while the pages are written out.  Pinning each victim keeps
+	 * the clock from choosing it twice. */
+	lock_acquire (&frame_lock);
+	while (victim_cnt < SWAP_BATCH_MAX) {
+		struct frame *victim = vm_get_victim ();
+		if (victim == NULL)
+			break;
+		victim->pinned = true;
+		victims[victim_cnt++] = victim;
+		if (VM_TYPE (victim->page->operations->type) == VM_ANON)
+			anon[anon_cnt++] = victim;
+	}
+	if (anon_cnt > 0)
+		anon_swap_out_batch (anon, anon_cnt, anon_ok);
+
+	for (i = a = 0; i < victim_cnt; i++) {
+		struct frame *victim = victims[i];
+		struct page *page = victim->page;
+		bool success;
+
+		victim->pinned = false;
+		if (VM_TYPE (page->operations->type) == VM_ANON)
+			success = anon_ok[a++];
+		else
+			success = page->operations->swap_out != NULL && swap_out (page);
+		if (!success)
+			continue;
+
+		while (!frame_detach (victim->page))
+			continue;
+		evictions++;
+		if (result == NULL) {
+			frame_untrack (victim);
+			result = victim;
+		} else
+			frame_free (victim);
+	}
+	lock_release (&frame_lock);
+	return result;
+}
 
-	return NULL;
+/* Returns a new frame for the user page at KVA, which backs no
+ * page yet, or a null pointer, freeing KVA, if memory is short. */
+static struct frame *
+frame_new (void *kva) {
+	struct frame *frame = malloc (sizeof *frame);
+
+	if (frame == NULL) {
+		palloc_free_page (kva);
+		return NULL;
+	}
+	frame->kva = kva;
+	frame->page = NULL;
+	list_init (&frame->pages);
+	frame->page_cnt = 0;
+	frame->pinned = false;
+	frame->tracked = false;
+	return frame;
 }
 
-/* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+/* palloc() and get frame.  If the user pool is exhausted, evicts a
+ * page to make room.  Returns a null pointer if that fails too. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva = palloc_get_page (PAL_USER);
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
-	return frame;
+	if (kva == NULL)
+		return vm_evict_frame ();
+	return frame_new (kva);
+}
+
+/* Makes FRAME back PAGE.  Must be called with frame_lock held. */
+static void
+frame_attach (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->page_cnt++;
+	frame->page = list_entry (list_front (&frame->pages), struct page,
+			frame_elem);
+	page->frame = frame;
+}
+
+/* Stops PAGE's frame from backing PAGE.  Returns true if the frame
+ * backs no page any more, in which case the caller must free or
+ * reuse it.  Must be called with frame_lock held. */
+static bool
+frame_detach (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	list_remove (&page->frame_elem);
+	page->frame = NULL;
+	if (--frame->page_cnt > 0) {
+		frame->page = list_entry (list_front (&frame->pages), struct page,
+				frame_elem);
+		return false;
+	}
+	frame->page = NULL;
+	return true;
+}
+
+/* Adds FRAME, whose page is now mapped, to the frame table, where
+ * the clock can find it.  Must be called with frame_lock held. */
+static void
+frame_track (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (!frame->tracked);
+	list_push_back (&frame_table, &frame->elem);
+	frame->tracked = true;
+}
+
+/* Removes FRAME from the frame table, if it is there.  Must be
+ * called with frame_lock held. */
+static void
+frame_untrack (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	if (frame->tracked) {
+		if (clock_hand == &frame->elem)
+			clock_hand = list_next (clock_hand);
+		list_remove (&frame->elem);
+		frame->tracked = false;
+	}
+}
+
+/* Frees FRAME, which backs no page.  Must be called with
+ * frame_lock held. */
+static void
+frame_free (struct frame *frame) {
+	frame_untrack (frame);
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Unmaps PAGE and lets go of its frame, if it has one, freeing the
+ * frame unless another process's page shares it.  The page's
+ * contents are lost. */
+void
+vm_free_frame (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL) {
+		struct frame *frame = page->frame;
+
+		if (page->pml4 != NULL)
+			pml4_clear_page (page->pml4, page->va);
+		if (frame_detach (page))
+			frame_free (frame);
+	}
+	lock_release (&frame_lock);
 }
 
 /* Growing the stack. */
@@ -123,20 +520,76 @@ static void
 vm_stack_growth (void *addr UNUSED) {
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.  PAGE is writable, but
+ * fork left its frame mapped read-only: give it a copy of the
+ * frame if another page still shares it, or else just map the
+ * frame read/write again. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	struct frame *old, *new;
+	bool success;
+
+	lock_acquire (&frame_lock);
+	old = page->frame;
+	if (old == NULL) {
+		/* Evicted since the fault: fault it back in, private. */
+		lock_release (&frame_lock);
+		return vm_do_claim_page (page);
+	}
+	if (old->page_cnt == 1) {
+		success = pml4_set_page (page->pml4, page->va, old->kva, true);
+		lock_release (&frame_lock);
+		count_stat (&cow_reused);
+		return success;
+	}
+
+	/* The other pages cannot write to OLD while PAGE shares it, and
+	 * pinning keeps the clock from taking it if they let go of it
+	 * in the meantime. */
+	old->pinned = true;
+	lock_release (&frame_lock);
+	new = vm_get_frame ();
+	if (new != NULL)
+		memcpy (new->kva, old->kva, PGSIZE);
+
+	lock_acquire (&frame_lock);
+	old->pinned = false;
+	if (new == NULL) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	if (frame_detach (page))
+		frame_free (old);
+	frame_attach (new, page);
+	frame_track (new);
+	success = pml4_set_page (page->pml4, page->va, new->kva, true);
+	lock_release (&frame_lock);
+
+	count_stat (&cow_copied);
+	return success;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
-
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
+		bool user UNUSED, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
+
+	/* Faults on kernel addresses are real faults.  The kernel may
+	 * fault on user addresses while copying to or from user
+	 * memory. */
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (page == NULL || (write && !page->writable))
+		return false;
+	/* A write to a present page can only be copy-on-write.  The
+	 * frame may have been evicted since the fault was taken, which
+	 * vm_handle_wp() checks under frame_lock. */
+	if (!not_present)
+		return write && vm_handle_wp (page);
 	return vm_do_claim_page (page);
 }
 
@@ -150,41 +603,214 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+	return page != NULL && vm_do_claim_page (page);
+}
 
-	return vm_do_claim_page (page);
+/* Fills FRAME with PAGE and maps it.  The page is filled in
+ * before it is mapped, so the process never sees it half
+ * loaded.  If PAGE turns out to be resident after all, FRAME is
+ * freed instead. */
+static bool
+vm_claim_frame (struct page *page, struct frame *frame) {
+	/* A fault taken while another thread was evicting PAGE waits
+	 * here for the eviction to finish.  If it failed, PAGE is back
+	 * on its old frame and mapped again: there is nothing to do. */
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL) {
+		frame_free (frame);
+		lock_release (&frame_lock);
+		return true;
+	}
+	frame_attach (frame, page);
+	lock_release (&frame_lock);
+
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (page->pml4, page->va, frame->kva,
+				page->writable)) {
+		vm_free_frame (page);
+		return false;
+	}
+
+	lock_acquire (&frame_lock);
+	frame_track (frame);
+	lock_release (&frame_lock);
+	return true;
 }
 
-/* Claim the PAGE and set up the mmu. */
+/* Claim the PAGE and set up the mmu.  A page coming back from swap
+ * brings along the process's pages in the slots just after it, as
+ * long as there are free frames for them: evicting other pages to
+ * make room for pages that may never be used would be a bad
+ * trade. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
-
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	struct page *ahead[SWAP_READAHEAD];
+	size_t ahead_cnt = 0;
+	struct frame *frame;
+
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		ahead_cnt = anon_swap_neighbours (page, ahead, SWAP_READAHEAD);
+
+	frame = vm_get_frame ();
+	if (frame == NULL || !vm_claim_frame (page, frame))
+		return false;
+
+	for (size_t i = 0; i < ahead_cnt; i++) {
+		void *kva = palloc_get_page (PAL_USER);
+		if (kva == NULL || (frame = frame_new (kva)) == NULL
+				|| !vm_claim_frame (ahead[i], frame))
+			break;
+		count_stat (&swap_readahead);
+	}
+	return true;
+}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+/* Returns a hash value for the page that E is embedded in. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *p = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&p->va, sizeof p->va);
+}
 
-	return swap_in (page, frame->kva);
+/* Returns true if the page that A is embedded in precedes the
+ * one that B is embedded in. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct page *pa = hash_entry (a, struct page, spt_elem);
+	const struct page *pb = hash_entry (b, struct page, spt_elem);
+	return pa->va < pb->va;
 }
 
-/* Initialize new supplemental page table */
+/* Initialize new supplemental page table.  If memory is short,
+ * SPT is left without a hash table, which spt_find_page() and
+ * spt_insert_page() treat as empty and full, respectively.  So is
+ * the SPT of a thread that never ran a user program, since
+ * threads start out zeroed. */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	if (!hash_init (&spt->pages, page_hash, page_less, NULL))
+		memset (&spt->pages, 0, sizeof spt->pages);
+	spt->regions = NULL;
+	spt->region_cnt = spt->region_cap = 0;
 }
 
-/* Copy supplemental page table from src to dst */
+/* Adds to DST, the running process's table, a copy of PAGE from
+ * its parent's table.  A page that has a frame shares it,
+ * read-only; the parent's mapping must be made read-only too. */
+static bool
+copy_page (struct supplemental_page_table *dst, struct page *page) {
+	struct thread *curr = thread_current ();
+	struct page *copy = malloc (sizeof *copy);
+	struct frame *frame;
+	bool success = true;
+
+	if (copy == NULL)
+		return false;
+	*copy = *page;
+	copy->pml4 = curr->pml4;
+	copy->frame = NULL;
+
+	/* A page still to be loaded from the executable reads the
+	 * child's own handle on it, which outlives the parent's. */
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& page->uninit.aux != NULL) {
+		struct file_load_aux *aux = malloc (sizeof *aux);
+		if (aux == NULL) {
+			free (copy);
+			return false;
+		}
+		*aux = *(struct file_load_aux *) page->uninit.aux;
+		aux->file = curr->running;
+		copy->uninit.aux = aux;
+	}
+	/* The copy shares the page's frame if it has one, and otherwise
+	 * its swap slot.  Both are decided in one critical section, so
+	 * that the clock cannot evict the frame in between, and the copy
+	 * is mapped before the lock is dropped, since the clock may evict
+	 * the shared frame, unmapping all of its pages, as soon as it
+	 * is. */
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		anon_fork (page, copy);
+	if (frame != NULL) {
+		frame_attach (frame, copy);
+		success = pml4_set_page (copy->pml4, copy->va, frame->kva, false);
+	}
+	lock_release (&frame_lock);
+
+	/* From here on, DST owns COPY, frame, slot and all. */
+	if (!spt_insert_page (dst, copy)) {
+		vm_dealloc_page (copy);
+		return false;
+	}
+	if (frame != NULL && success)
+		count_stat (&cow_shared);
+	return success;
+}
+
+/* Copy supplemental page table from src to dst.  DST must be the
+ * running process's table, and SRC its parent's, whose pages the
+ * copy shares frames with until either process writes to them.
+ * Copying takes time in proportion to the number of pages, not to
+ * their contents. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+	struct tlb_batch batch;
+	uint64_t *src_pml4 = NULL;
+
+	ASSERT (dst == &thread_current ()->spt);
+
+	if (src->region_cnt > 0) {
+		dst->regions = malloc (src->region_cnt * sizeof *dst->regions);
+		if (dst->regions == NULL)
+			return false;
+		memcpy (dst->regions, src->regions,
+				src->region_cnt * sizeof *dst->regions);
+		dst->region_cnt = dst->region_cap = src->region_cnt;
+	}
+
+	if (src->pages.buckets == NULL)
+		return true;
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+		if (!copy_page (dst, page))
+			return false;
+		src_pml4 = page->pml4;
+	}
+
+	/* Write-protect the parent's side of the shared frames, one
+	 * region at a time, with a single TLB flush at the end. */
+	if (src_pml4 != NULL) {
+		tlb_batch_init (&batch, src_pml4);
+		for (size_t r = 0; r < src->region_cnt; r++) {
+			struct vm_region *region = &src->regions[r];
+			pml4_protect_range (src_pml4, region->start,
+					((uint8_t *) region->end - (uint8_t *) region->start) / PGSIZE,
+					false, &batch);
+		}
+		tlb_batch_flush (&batch);
+	}
+	return true;
+}
+
+/* hash_destroy() helper for supplemental_page_table_kill(). */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (hash_entry (e, struct page, spt_elem));
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Free the resource hold by the supplemental page table, leaving
+ * it as if it had never been initialized. */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	hash_destroy (&spt->pages, page_destructor);
+	free (spt->regions);
+	memset (spt, 0, sizeof *spt);
 }